@@ -32,6 +32,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,6 +48,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors a single READ/WRITE command can transfer. */
+#define MAX_XFER_SECTORS 256
+
+/* Largest READ/WRITE MULTIPLE block we ask for, in sectors. */
+#define MAX_MULTIPLE_SECTORS 16
 
 /* An ATA device. */
 struct disk {
@@ -56,9 +66,12 @@ struct disk {
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
 	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
+	size_t multiple;            /* Sectors per interrupt for READ/WRITE
+								   MULTIPLE, 0 if not supported. */
 
 	long long read_cnt;         /* Number of sectors read. */
 	long long write_cnt;        /* Number of sectors written. */
+	long long cmd_cnt;          /* Number of read and write commands. */
 };
 
 /* An ATA channel (aka controller).
@@ -83,11 +96,15 @@ static struct channel channels[CHANNEL_CNT];
 static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
+static void set_multiple_mode (struct disk *, size_t max_multiple);
 
 static void select_sector (struct disk *, disk_sector_t);
+static void select_sectors (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
 
 static void wait_until_idle (const struct disk *);
 static bool wait_while_busy (const struct disk *);
@@ -132,8 +149,9 @@ disk_init (void) {
 
 			d->is_ata = false;
 			d->capacity = 0;
+			d->multiple = 0;
 
-			d->read_cnt = d->write_cnt = 0;
+			d->read_cnt = d->write_cnt = d->cmd_cnt = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -167,8 +185,8 @@ disk_print_stats (void) {
 		for (dev_no = 0; dev_no < 2; dev_no++) {
 			struct disk *d = disk_get (chan_no, dev_no);
 			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
+				printf ("%s: %lld reads, %lld writes, %lld commands\n",
+						d->name, d->read_cnt, d->write_cnt, d->cmd_cnt);
 		}
 	}
 }
@@ -223,6 +241,7 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
 		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
 	input_sector (c, buffer);
 	d->read_cnt++;
+	d->cmd_cnt++;
 	lock_release (&c->lock);
 }
 
@@ -247,6 +266,104 @@ disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
 	output_sector (c, buffer);
 	sema_down (&c->completion_wait);
 	d->write_cnt++;
+	d->cmd_cnt++;
+	lock_release (&c->lock);
+}
+
+/* Returns the number of sectors disk D moves per interrupt in a
+   transfer that has LEFT sectors to go. */
+static size_t
+block_sectors (const struct disk *d, size_t left) {
+	size_t block = d->multiple > 0 ? d->multiple : 1;
+	return left < block ? left : block;
+}
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Every run of up to MAX_XFER_SECTORS sectors takes a
+   single command, and with READ MULTIPLE the disk interrupts once
+   per block instead of once per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
+	struct channel *c;
+	uint8_t *p = buffer;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t xfer = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+		size_t left;
+
+		select_sectors (d, sec_no, xfer);
+		issue_pio_command (c, d->multiple > 0
+				? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+		for (left = xfer; left > 0; ) {
+			size_t block = block_sectors (d, left);
+
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk read failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) (xfer - left));
+			input_sectors (c, p, block);
+			p += block * DISK_SECTOR_SIZE;
+			left -= block;
+		}
+		d->read_cnt += xfer;
+		d->cmd_cnt++;
+
+		sec_no += xfer;
+		cnt -= xfer;
+	}
+	lock_release (&c->lock);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Batches sectors into commands as disk_read_sectors() does.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
+	struct channel *c;
+	const uint8_t *p = buffer;
+
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	c = d->channel;
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		size_t xfer = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+		size_t left;
+
+		select_sectors (d, sec_no, xfer);
+		issue_pio_command (c, d->multiple > 0
+				? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+		for (left = xfer; left > 0; ) {
+			size_t block = block_sectors (d, left);
+
+			if (!wait_while_busy (d))
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+						d->name, sec_no + (disk_sector_t) (xfer - left));
+			output_sectors (c, p, block);
+			sema_down (&c->completion_wait);
+			p += block * DISK_SECTOR_SIZE;
+			left -= block;
+		}
+		d->write_cnt += xfer;
+		d->cmd_cnt++;
+
+		sec_no += xfer;
+		cnt -= xfer;
+	}
 	lock_release (&c->lock);
 }
 
@@ -364,6 +481,9 @@ identify_ata_device (struct disk *d) {
 	/* Calculate capacity. */
 	d->capacity = id[60] | ((uint32_t) id[61] << 16);
 
+	/* Word 47 holds the largest READ/WRITE MULTIPLE block. */
+	set_multiple_mode (d, id[47] & 0xff);
+
 	/* Print identification message. */
 	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
 	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
@@ -382,6 +502,30 @@ identify_ata_device (struct disk *d) {
 	printf ("\"\n");
 }
 
+/* Turns on READ/WRITE MULTIPLE for disk D with the largest power
+   of two block that is at most MAX_MULTIPLE and at most
+   MAX_MULTIPLE_SECTORS.  Leaves D in one-sector-per-interrupt mode
+   if the disk does not support it or rejects the command. */
+static void
+set_multiple_mode (struct disk *d, size_t max_multiple) {
+	struct channel *c = d->channel;
+	size_t multiple = 1;
+
+	if (max_multiple == 0)
+		return;
+	while (multiple * 2 <= max_multiple
+			&& multiple * 2 <= MAX_MULTIPLE_SECTORS)
+		multiple *= 2;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), multiple);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if ((inb (reg_status (c)) & STA_ERR) == 0)
+		d->multiple = multiple;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -406,13 +550,23 @@ print_ata_string (char *string, size_t size) {
    use LBA mode.) */
 static void
 select_sector (struct disk *d, disk_sector_t sec_no) {
+	select_sectors (d, sec_no, 1);
+}
+
+/* Like select_sector(), but sets up a transfer of CNT sectors
+   starting at SEC_NO.  CNT must be between 1 and
+   MAX_XFER_SECTORS; the sector count register encodes 256 as 0. */
+static void
+select_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
+	ASSERT (cnt >= 1 && cnt <= MAX_XFER_SECTORS);
 	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt <= d->capacity - sec_no);
+	ASSERT (sec_no + cnt <= (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt % MAX_XFER_SECTORS);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -445,6 +599,21 @@ static void
 output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
+
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes. */
+static void
+input_sectors (struct channel *c, void *sectors, size_t cnt) {
+	insw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
+}
+
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode. */
+static void
+output_sectors (struct channel *c, const void *sectors, size_t cnt) {
+	outsw (reg_data (c), sectors, cnt * DISK_SECTOR_SIZE / 2);
+}
 
 /* Low-level ATA primitives. */
 
@@ -19,61 +19,192 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Project 1 */
-static int64_t minEndTick = -1;
+/* 8254 input frequency, and that divided by TIMER_FREQ, rounded
+   to nearest: the count for one timer tick. */
+#define PIT_HZ 1193180
+#define PIT_TICK_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks a single one-shot count can span. */
+#define ONESHOT_MAX_TICKS (UINT16_MAX / PIT_TICK_COUNT)
+
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
 
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* While the idle CPU waits on a one-shot count, the number of
+   ticks until it ends; 0 while the timer runs periodically. */
+static int64_t oneshot_ticks;
+
+/* PIT counts left over from one-shot counts cut short, not yet
+   adding up to a whole tick. */
+static unsigned oneshot_residue;
+
+/* Ticks that passed without an interrupt while idle. */
+static int64_t skipped_ticks;
+
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate(), unless already set by
+   timer_preset_loops(). */
 static unsigned loops_per_tick;
 
+/* Nanoseconds in a second and in a timer tick. */
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_TICK (NSEC_PER_SEC / TIMER_FREQ)
+
+/* Timer ticks timer_calibrate() counts TSC cycles over. */
+#define TSC_CALIBRATE_TICKS 5
+
+/* TSC clock source.  TSC_HZ is the TSC's frequency, measured
+   against the PIT by timer_calibrate(), or 0 until then.  A cycle
+   count C converts to (C * TSC_MULT) >> 32 nanoseconds. */
+static uint64_t tsc_boot;
+static uint64_t tsc_hz;
+static uint64_t tsc_mult;
+
+/* Longest time, in TSC cycles, that timer_interrupt() has run
+   with interrupts off, and the tick at which that happened. */
+static uint64_t max_intr_cycles;
+static int64_t max_intr_tick;
+
+/* Total TSC cycles spent in timer_interrupt(), to tell how much
+   of each tick the handler itself uses up. */
+static uint64_t total_intr_cycles;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
+static void advance(int64_t n);
+
+/* Reads the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc(void)
+{
+	uint32_t lo, hi;
+	asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/* Returns the CPU's time-stamp counter, for timing intervals too
+   short for timer_now_ns() to be worth its conversion. */
+uint64_t
+timer_cycles(void)
+{
+	return rdtsc();
+}
+
+/* Converts a count of TSC cycles into nanoseconds.  Returns 0
+   until timer_calibrate() has measured the TSC. */
+int64_t
+timer_cycles_to_ns(uint64_t cycles)
+{
+	return ((unsigned __int128)cycles * tsc_mult) >> 32;
+}
+
+/* Starts PIT counter 0 counting down from COUNT in MODE: 2 to
+   interrupt every COUNT cycles, 0 to interrupt once. */
+static void
+pit_program(int mode, uint16_t count)
+{
+	outb(0x43, 0x30 | (mode << 1)); /* CW: counter 0, LSB then MSB, MODE, binary. */
+	outb(0x40, count & 0xff);
+	outb(0x40, count >> 8);
+}
+
+/* Returns the current value of PIT counter 0. */
+static uint16_t
+pit_read(void)
+{
+	uint8_t lo, hi;
+
+	outb(0x43, 0x00); /* CW: latch counter 0. */
+	lo = inb(0x40);
+	hi = inb(0x40);
+	return (hi << 8) | lo;
+}
+
+/* Returns true if PIT counter 0 has reached terminal count in
+   one-shot mode, i.e. its interrupt is raised or pending. */
+static bool
+pit_fired(void)
+{
+	outb(0x43, 0xe2); /* Read-back: status of counter 0. */
+	return (inb(0x40) & 0x80) != 0;
+}
+
+/* Returns true if the timer interrupt has been raised at the PIC
+   but not delivered yet, as when a tick ends with interrupts off. */
+static bool
+timer_irq_pending(void)
+{
+	outb(0x20, 0x0a); /* OCW3: next read of the master PIC is its IRR. */
+	return (inb(0x20) & 0x01) != 0;
+}
 
 /* Sets up the 8254 Programmable Interval Timer (PIT) to
    interrupt PIT_FREQ times per second, and registers the
    corresponding interrupt. */
 void timer_init(void)
 {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb(0x43, 0x34); /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb(0x40, count & 0xff);
-	outb(0x40, count >> 8);
+	pit_program(2, PIT_TICK_COUNT);
+	tsc_boot = rdtsc();
 
 	intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Sets loops_per_tick to LOOPS, as measured on an earlier boot on
+   the same host, so that timer_calibrate() can skip measuring it. */
+void timer_preset_loops(unsigned loops)
+{
+	ASSERT(loops > 0);
+	loops_per_tick = loops;
+}
+
+/* Calibrates loops_per_tick, used to implement brief delays, and
+   the TSC clock source. */
 void timer_calibrate(void)
 {
 	unsigned high_bit, test_bit;
+	uint64_t tsc_start;
+	int64_t start;
 
 	ASSERT(intr_get_level() == INTR_ON);
 	printf("Calibrating timer...  ");
 
-	/* Approximate loops_per_tick as the largest power-of-two
-	   still less than one timer tick. */
-	loops_per_tick = 1u << 10;
-	while (!too_many_loops(loops_per_tick << 1))
+	if (loops_per_tick == 0)
 	{
-		loops_per_tick <<= 1;
-		ASSERT(loops_per_tick != 0);
+		/* Approximate loops_per_tick as the largest power-of-two
+		   still less than one timer tick. */
+		loops_per_tick = 1u << 10;
+		while (!too_many_loops(loops_per_tick << 1))
+		{
+			loops_per_tick <<= 1;
+			ASSERT(loops_per_tick != 0);
+		}
+
+		/* Refine the next 8 bits of loops_per_tick. */
+		high_bit = loops_per_tick;
+		for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
+			if (!too_many_loops(high_bit | test_bit))
+				loops_per_tick |= test_bit;
 	}
 
-	/* Refine the next 8 bits of loops_per_tick. */
-	high_bit = loops_per_tick;
-	for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-		if (!too_many_loops(high_bit | test_bit))
-			loops_per_tick |= test_bit;
+	/* Count TSC cycles from one tick boundary to another. */
+	start = ticks;
+	while (ticks == start)
+		barrier();
+	tsc_start = rdtsc();
+	start = ticks;
+	while (ticks - start < TSC_CALIBRATE_TICKS)
+		barrier();
+	tsc_hz = (rdtsc() - tsc_start) * TIMER_FREQ / TSC_CALIBRATE_TICKS;
+	tsc_mult = ((uint64_t)NSEC_PER_SEC << 32) / tsc_hz;
 
-	printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+	printf("%'" PRIu64 " loops/s, %'" PRIu64 " kHz TSC.\n",
+		   (uint64_t)loops_per_tick * TIMER_FREQ, tsc_hz / 1000);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -95,6 +226,17 @@ timer_elapsed(int64_t then)
 	return timer_ticks() - then;
 }
 
+/* Returns the number of nanoseconds since the timer was set up.
+   Reads the TSC once it has been calibrated, and falls back to
+   timer tick resolution before that. */
+int64_t
+timer_now_ns(void)
+{
+	if (tsc_hz == 0)
+		return timer_ticks() * NSEC_PER_TICK;
+	return timer_cycles_to_ns(rdtsc() - tsc_boot);
+}
+
 /* Suspends execution for approximately TICKS timer ticks. */
 void timer_sleep(int64_t ticks)
 {
@@ -105,9 +247,6 @@ void timer_sleep(int64_t ticks)
 	if (timer_elapsed(start) < ticks)
 	{
 		curr->endTick = start + ticks;
-
-		if (minEndTick == -1 || curr->endTick < minEndTick)
-			minEndTick = curr->endTick;
 		sleep();
 	}
 }
@@ -130,49 +269,148 @@ void timer_nsleep(int64_t ns)
 	real_time_sleep(ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts with nothing to run.  In tickless mode, replaces the
+   periodic tick with a single interrupt at the first tick that has
+   work to do: the next sleeping thread's wake-up, or the next
+   once-a-second MLFQS update. */
+void timer_idle_enter(void)
+{
+	int64_t limit, next;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	if (!timer_tickless || oneshot_ticks != 0 || timer_irq_pending())
+		return;
+
+	limit = ticks + ONESHOT_MAX_TICKS;
+	if (thread_mlfqs && limit > ticks - ticks % TIMER_FREQ + TIMER_FREQ)
+		limit = ticks - ticks % TIMER_FREQ + TIMER_FREQ;
+	next = thread_next_wakeup(limit);
+	if (next - ticks < 2)
+		return;
+
+	/* Keep the phase of the periodic tick: the count ends on the
+	   tick boundary NEXT, not a whole number of ticks from now. */
+	oneshot_ticks = next - ticks;
+	pit_program(0, (oneshot_ticks - 1) * PIT_TICK_COUNT + pit_read());
+
+	/* A periodic tick that ended just before the counter was
+	   reprogrammed is still pending and would be taken for the end of
+	   the one-shot count, crediting all of its ticks at once.  Go back
+	   to the periodic tick and let it count as one. */
+	if (timer_irq_pending())
+	{
+		oneshot_ticks = 0;
+		pit_program(2, PIT_TICK_COUNT);
+	}
+}
+
+/* Called by the idle thread, with interrupts off, once it is done
+   halting.  If it was woken by something other than the one-shot
+   count, credits the ticks that have passed so far and restarts
+   the periodic tick. */
+void timer_idle_exit(void)
+{
+	unsigned elapsed;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	if (oneshot_ticks == 0 || pit_fired())
+		return; /* Periodic, or the timer interrupt is on its way. */
+
+	/* PIT counts since the last tick we counted. */
+	elapsed = oneshot_ticks * PIT_TICK_COUNT - pit_read() + oneshot_residue;
+	oneshot_ticks = 0;
+	pit_program(2, PIT_TICK_COUNT);
+
+	oneshot_residue = elapsed % PIT_TICK_COUNT;
+	skipped_ticks += elapsed / PIT_TICK_COUNT;
+	advance(elapsed / PIT_TICK_COUNT);
+}
+
 /* Prints timer statistics. */
 void timer_print_stats(void)
 {
 	printf("Timer: %" PRId64 " ticks\n", timer_ticks());
+	if (timer_tickless)
+		printf("Timer: %" PRId64 " ticks skipped while idle\n", skipped_ticks);
+	printf("Timer: %" PRId64 " ns in interrupts, longest %" PRId64
+		   " ns at tick %" PRId64 "\n",
+		   timer_cycles_to_ns(total_intr_cycles), timer_cycles_to_ns(max_intr_cycles),
+		   max_intr_tick);
 }
 
-// 1-4 fixed-point representation multiplier
-const int F = 1 << 14;
-
-/* Timer interrupt handler. */
-static void
-timer_interrupt(struct intr_frame *args UNUSED)
+/* Returns the longest time, in nanoseconds, that the timer
+   interrupt handler has run since the last call to
+   timer_reset_max_latency(). */
+int64_t
+timer_max_latency(void)
 {
-	ticks++;
-
-	while (minEndTick != -1 && minEndTick <= ticks)
-	{
-		enum intr_level old_level = intr_disable();
-
-		minEndTick = wake_up();
+	return timer_cycles_to_ns(max_intr_cycles);
+}
 
-		intr_set_level(old_level);
-	}
+/* Restarts the measurement reported by timer_max_latency(). */
+void timer_reset_max_latency(void)
+{
+	enum intr_level old_level = intr_disable();
+	max_intr_cycles = 0;
+	max_intr_tick = 0;
+	intr_set_level(old_level);
+}
 
-	if (thread_mlfqs)
+/* Advances the clock by N ticks, doing each tick's scheduler
+   bookkeeping and waking the threads that are due. */
+static void
+advance(int64_t n)
+{
+	for (; n > 0; n--)
 	{
-		struct thread *t = thread_current();
-		if (!(thread_name() == "idle"))
-			t->recent_cpu += F; //increase recent_cpu on each tick
+		ticks++;
 
-		// update mlfqs recent_cpu and load_avg for every seconds
-		if (ticks % TIMER_FREQ == 0)
+		if (thread_mlfqs)
 		{
-			update_load_avg();
-			total_update_recentcpu();
+			thread_charge_recentcpu(); //increase recent_cpu on each tick
+
+			// update mlfqs recent_cpu and load_avg for every seconds
+			if (ticks % TIMER_FREQ == 0)
+			{
+				update_load_avg();
+				total_update_recentcpu();
+			}
+
+			// update mlfqs priority for every four ticks
+			if (ticks % 4 == 0)
+				total_update_priority();
 		}
+	}
+	wake_up(ticks);
+}
+
+/* Timer interrupt handler. */
+static void
+timer_interrupt(struct intr_frame *args UNUSED)
+{
+	uint64_t start = rdtsc();
+	int64_t n = 1;
 
-		// update mlfqs priority for every four ticks
-		if (ticks % 4 == 0)
-			total_update_priority();
+	/* A one-shot count covers several ticks; go back to periodic. */
+	if (oneshot_ticks != 0)
+	{
+		n = oneshot_ticks;
+		skipped_ticks += n - 1;
+		oneshot_ticks = 0;
+		pit_program(2, PIT_TICK_COUNT);
 	}
 
+	advance(n);
 	thread_tick();
+
+	uint64_t cycles = rdtsc() - start;
+	total_intr_cycles += cycles;
+	if (cycles > max_intr_cycles)
+	{
+		max_intr_cycles = cycles;
+		max_intr_tick = ticks;
+	}
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -221,7 +459,18 @@ real_time_sleep(int64_t num, int32_t denom)
 	int64_t ticks = num * TIMER_FREQ / denom;
 
 	ASSERT(intr_get_level() == INTR_ON);
-	if (ticks > 0)
+	if (tsc_hz != 0)
+	{
+		/* Sleep through the whole ticks, then spin on the TSC for
+		   whatever is left, which is less than a tick. */
+		ASSERT(NSEC_PER_SEC % denom == 0);
+		int64_t end = timer_now_ns() + num * (NSEC_PER_SEC / denom);
+		if (ticks > 0)
+			timer_sleep(ticks);
+		while (timer_now_ns() < end)
+			asm volatile("pause");
+	}
+	else if (ticks > 0)
 	{
 		/* We're waiting for at least one full timer tick.  Use
 		   timer_sleep() because it will yield the CPU to other
@@ -0,0 +1,311 @@
+/* buffer_cache.c: Sector cache in front of the file system disk. */
+
+#include "filesys/buffer_cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors the cache holds (32 kB). */
+#define BUFFER_CACHE_SIZE 64
+
+/* A cached sector. */
+struct cache_entry {
+	struct hash_elem elem;              /* Element in cache_map. */
+	disk_sector_t sector;               /* Sector held, if in_use. */
+	bool in_use;                        /* True if DATA holds SECTOR. */
+	bool dirty;                         /* True if DATA is newer than disk. */
+	bool accessed;                      /* Used since the clock hand passed. */
+	bool busy;                          /* DATA is being read or written. */
+	int pin_cnt;                        /* Copies to or from DATA under way. */
+	uint8_t *data;                      /* DISK_SECTOR_SIZE bytes. */
+};
+
+static struct cache_entry cache[BUFFER_CACHE_SIZE];
+static struct hash cache_map;           /* Sector -> entry, in-use entries only. */
+static struct lock cache_lock;          /* Protects everything above. */
+static struct condition io_done;        /* Signaled when an entry stops being
+                                           busy or pinned. */
+static size_t clock_hand;               /* Next entry eviction looks at. */
+
+/* Statistics. */
+static long long hit_cnt;               /* # of accesses served from the cache. */
+static long long miss_cnt;              /* # of accesses that had to read the disk. */
+static long long writeback_cnt;         /* # of dirty sectors written back. */
+
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct cache_entry *ce = hash_entry (e, struct cache_entry, elem);
+	return hash_int (ce->sector);
+}
+
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+	const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+	return a->sector < b->sector;
+}
+
+/* Initializes the buffer cache. */
+void
+buffer_cache_init (void) {
+	uint8_t *data;
+	size_t i;
+
+	data = palloc_get_multiple (PAL_ASSERT,
+			BUFFER_CACHE_SIZE * DISK_SECTOR_SIZE / PGSIZE);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		cache[i].in_use = false;
+		cache[i].busy = false;
+		cache[i].pin_cnt = 0;
+		cache[i].data = data + i * DISK_SECTOR_SIZE;
+	}
+	hash_init (&cache_map, cache_hash, cache_less, NULL);
+	lock_init (&cache_lock);
+	cond_init (&io_done);
+	clock_hand = 0;
+}
+
+/* Writes every dirty sector back to disk. Called at shutdown. */
+void
+buffer_cache_done (void) {
+	buffer_cache_flush ();
+}
+
+/* Transfers CE's sector between its data and the disk, writing it
+ * if WRITE is true and reading it otherwise. CE is marked busy and
+ * cache_lock is released for the transfer, so that accesses to
+ * other sectors go on meanwhile; anyone who wants CE waits until it
+ * is no longer busy. */
+static void
+cache_io (struct cache_entry *ce, bool write) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (!ce->busy);
+
+	ce->busy = true;
+	lock_release (&cache_lock);
+	if (write)
+		disk_write (filesys_disk, ce->sector, ce->data);
+	else
+		disk_read (filesys_disk, ce->sector, ce->data);
+	lock_acquire (&cache_lock);
+	ce->busy = false;
+	cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Writes CE back to disk if it is dirty. CE must not be busy. */
+static void
+cache_writeback (struct cache_entry *ce) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	if (ce->in_use && ce->dirty) {
+		ce->dirty = false;
+		writeback_cnt++;
+		cache_io (ce, true);
+	}
+}
+
+/* Returns the entry holding SECTOR, or a null pointer. */
+static struct cache_entry *
+cache_find (disk_sector_t sector) {
+	struct cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&cache_map, &key.elem);
+	return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Picks an entry to reuse with the clock algorithm and returns it
+ * out of cache_map. Busy and pinned entries are passed over. If the
+ * entry picked
+ * is dirty, writes it back instead and returns a null pointer, as it
+ * does after waiting when every entry is busy: cache_lock was
+ * released meanwhile, so the caller must look its sector up again. */
+static struct cache_entry *
+cache_evict (void) {
+	struct cache_entry *ce;
+	size_t scan_cnt;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	/* One sweep clears every accessed bit, so if a second one finds
+	 * nothing, every entry is busy or pinned. */
+	for (scan_cnt = 0; scan_cnt < 2 * BUFFER_CACHE_SIZE; scan_cnt++) {
+		ce = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % BUFFER_CACHE_SIZE;
+
+		if (ce->busy || ce->pin_cnt > 0)
+			continue;
+		if (!ce->in_use)
+			return ce;
+		if (ce->accessed) {
+			ce->accessed = false;
+			continue;
+		}
+		if (ce->dirty) {
+			cache_writeback (ce);
+			return NULL;
+		}
+		hash_delete (&cache_map, &ce->elem);
+		ce->in_use = false;
+		return ce;
+	}
+
+	cond_wait (&io_done, &cache_lock);
+	return NULL;
+}
+
+/* Returns the entry holding SECTOR, reading it in if necessary, and
+ * pins it. */
+static struct cache_entry *
+cache_get (disk_sector_t sector) {
+	struct cache_entry *ce;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		ce = cache_find (sector);
+		if (ce != NULL) {
+			if (!ce->busy) {
+				hit_cnt++;
+				break;
+			}
+			cond_wait (&io_done, &cache_lock);
+		} else if ((ce = cache_evict ()) != NULL) {
+			miss_cnt++;
+			ce->sector = sector;
+			ce->in_use = true;
+			ce->dirty = false;
+			hash_insert (&cache_map, &ce->elem);
+			cache_io (ce, false);
+			break;
+		}
+	}
+	ce->accessed = true;
+	ce->pin_cnt++;
+	return ce;
+}
+
+/* Drops a pin cache_get() took on CE. */
+static void
+cache_unpin (struct cache_entry *ce) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	ASSERT (ce->pin_cnt > 0);
+
+	if (--ce->pin_cnt == 0)
+		cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER.
+ * BUFFER may be in user memory, where the copy can fault and reenter
+ * the cache, so it is done with the entry pinned instead of under
+ * cache_lock. */
+void
+buffer_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *ce;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	ce = cache_get (sector);
+	lock_release (&cache_lock);
+
+	memcpy (buffer, ce->data + ofs, size);
+
+	lock_acquire (&cache_lock);
+	cache_unpin (ce);
+	lock_release (&cache_lock);
+}
+
+/* Copies a whole sector from BUFFER into SECTOR without reading it
+ * from disk first. The copy goes into a free entry that is put in
+ * cache_map only once it is complete, so that no one reads the
+ * sector half written; if SECTOR was brought in meanwhile, the entry
+ * that holds it is overwritten instead. */
+static void
+cache_write_sector (disk_sector_t sector, const void *buffer) {
+	struct cache_entry *fresh, *ce;
+
+	lock_acquire (&cache_lock);
+	while ((fresh = cache_evict ()) == NULL)
+		continue;
+	fresh->pin_cnt++;
+	lock_release (&cache_lock);
+
+	memcpy (fresh->data, buffer, DISK_SECTOR_SIZE);
+
+	lock_acquire (&cache_lock);
+	while ((ce = cache_find (sector)) != NULL && ce->busy)
+		cond_wait (&io_done, &cache_lock);
+	if (ce != NULL) {
+		hit_cnt++;
+		memcpy (ce->data, fresh->data, DISK_SECTOR_SIZE);
+	} else {
+		miss_cnt++;
+		ce = fresh;
+		ce->sector = sector;
+		ce->in_use = true;
+		hash_insert (&cache_map, &ce->elem);
+	}
+	ce->dirty = true;
+	ce->accessed = true;
+	cache_unpin (fresh);
+	lock_release (&cache_lock);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte OFS.
+ * The sector reaches the disk when it is evicted or flushed. As in
+ * buffer_cache_read(), BUFFER is copied from outside cache_lock. */
+void
+buffer_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size) {
+	struct cache_entry *ce;
+
+	ASSERT (ofs >= 0 && ofs + size <= DISK_SECTOR_SIZE);
+
+	if (size == DISK_SECTOR_SIZE) {
+		cache_write_sector (sector, buffer);
+		return;
+	}
+
+	lock_acquire (&cache_lock);
+	ce = cache_get (sector);
+	lock_release (&cache_lock);
+
+	memcpy (ce->data + ofs, buffer, size);
+
+	/* Set only now, so that a writeback that ran during the copy is
+	 * followed by another. */
+	lock_acquire (&cache_lock);
+	ce->dirty = true;
+	cache_unpin (ce);
+	lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+buffer_cache_flush (void) {
+	size_t i;
+
+	lock_acquire (&cache_lock);
+	for (i = 0; i < BUFFER_CACHE_SIZE; i++) {
+		while (cache[i].busy)
+			cond_wait (&io_done, &cache_lock);
+		cache_writeback (&cache[i]);
+	}
+	lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	printf ("Buffer cache: %lld hits, %lld misses, %lld write-backs\n",
+			hit_cnt, miss_cnt, writeback_cnt);
+}
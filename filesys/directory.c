@@ -1,6 +1,7 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -16,7 +17,31 @@ struct dir {
 struct dir_entry {
 	disk_sector_t inode_sector;         /* Sector number of header. */
 	char name[NAME_MAX + 1];            /* Null terminated file name. */
-	bool in_use;                        /* In use or free? */
+	uint8_t state;                      /* One of ENTRY_*. */
+};
+
+/* Directory entry states. */
+#define ENTRY_FREE 0                    /* Never used. */
+#define ENTRY_USED 1                    /* Holds a file. */
+#define ENTRY_DELETED 2                 /* Used once; hashed directories only. */
+#define ENTRY_HEADER 3                  /* Header of a hashed directory. */
+
+/* A directory starts out as a plain array of entries. Once it holds
+ * more than DIR_LINEAR_MAX of them it becomes a hash table: a header
+ * in the first entry's place, then SLOT_CNT entries placed by the
+ * hash of their names and probed linearly, so finding a name reads a
+ * slot or two instead of the whole directory. The table doubles when
+ * it is three quarters full. */
+#define DIR_LINEAR_MAX 32               /* Most entries in a plain directory. */
+#define DIR_HASH_MIN 64                 /* Fewest slots in a hash table. */
+
+/* Header of a hashed directory.
+ * Must be the size of a directory entry, with STATE in the same place. */
+struct dir_header {
+	uint32_t slot_cnt;                  /* Slots after the header, a power of 2. */
+	uint32_t fill_cnt;                  /* Slots used or deleted. */
+	uint8_t unused[NAME_MAX + 1 - sizeof (uint32_t)];
+	uint8_t state;                      /* ENTRY_HEADER. */
 };
 
 /* Creates a directory with space for ENTRY_CNT entries in the
@@ -71,6 +96,27 @@ dir_get_inode (struct dir *dir) {
 	return dir->inode;
 }
 
+/* Reads DIR's hash table header into *H.
+ * Returns true if DIR is hashed, false if it is a plain array. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) {
+	return inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+		&& h->state == ENTRY_HEADER;
+}
+
+/* Returns the byte offset of slot I of a hash table with header H. */
+static off_t
+slot_ofs (const struct dir_header *h, size_t i) {
+	return (1 + i % h->slot_cnt) * sizeof (struct dir_entry);
+}
+
+/* Returns the slot where probing for NAME starts in a hash table with
+ * header H. */
+static size_t
+slot_hash (const struct dir_header *h, const char *name) {
+	return hash_string (name) & (h->slot_cnt - 1);
+}
+
 /* Searches DIR for a file with the given NAME.
  * If successful, returns true, sets *EP to the directory entry
  * if EP is non-null, and sets *OFSP to the byte offset of the
@@ -79,22 +125,92 @@ dir_get_inode (struct dir *dir) {
 static bool
 lookup (const struct dir *dir, const char *name,
 		struct dir_entry *ep, off_t *ofsp) {
+	struct dir_header h;
 	struct dir_entry e;
 	size_t ofs;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
+	if (read_header (dir, &h)) {
+		size_t start = slot_hash (&h, name), i;
+
+		for (i = 0; i < h.slot_cnt; i++) {
+			ofs = slot_ofs (&h, start + i);
+			if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+					|| e.state == ENTRY_FREE)
+				break;
+			if (e.state == ENTRY_USED && !strcmp (name, e.name))
+				goto found;
+		}
+		return false;
+	}
+
 	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 			ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL)
-				*ep = e;
-			if (ofsp != NULL)
-				*ofsp = ofs;
-			return true;
-		}
+		if (e.state == ENTRY_USED && !strcmp (name, e.name))
+			goto found;
 	return false;
+
+found:
+	if (ep != NULL)
+		*ep = e;
+	if (ofsp != NULL)
+		*ofsp = ofs;
+	return true;
+}
+
+/* Rewrites DIR as a hash table with at least SLOT_CNT slots, enough
+ * to keep it at most half full.
+ * Returns true if successful, false on failure, in which case DIR is
+ * left as it was. */
+static bool
+rehash (struct dir *dir, size_t slot_cnt) {
+	struct dir_entry *old = NULL, *table = NULL;
+	struct dir_header *h;
+	size_t old_cnt, used_cnt, i;
+	off_t length = inode_length (dir->inode);
+	bool success = false;
+
+	ASSERT (sizeof (struct dir_header) == sizeof (struct dir_entry));
+
+	/* Read the whole directory. */
+	old_cnt = length / sizeof *old;
+	old = malloc (old_cnt * sizeof *old);
+	if (old == NULL
+			|| inode_read_at (dir->inode, old, old_cnt * sizeof *old, 0)
+			!= (off_t) (old_cnt * sizeof *old))
+		goto done;
+	for (used_cnt = i = 0; i < old_cnt; i++)
+		if (old[i].state == ENTRY_USED)
+			used_cnt++;
+
+	/* Size the table and never shrink the directory file. */
+	while (slot_cnt < 2 * used_cnt || slot_cnt < old_cnt)
+		slot_cnt *= 2;
+	table = calloc (1 + slot_cnt, sizeof *table);
+	if (table == NULL)
+		goto done;
+
+	h = (struct dir_header *) &table[0];
+	h->slot_cnt = slot_cnt;
+	h->fill_cnt = used_cnt;
+	h->state = ENTRY_HEADER;
+	for (i = 0; i < old_cnt; i++)
+		if (old[i].state == ENTRY_USED) {
+			size_t slot = slot_hash (h, old[i].name);
+			while (table[1 + slot].state != ENTRY_FREE)
+				slot = (slot + 1) & (slot_cnt - 1);
+			table[1 + slot] = old[i];
+		}
+
+	length = (1 + slot_cnt) * sizeof *table;
+	success = inode_write_at (dir->inode, table, length, 0) == length;
+
+done:
+	free (table);
+	free (old);
+	return success;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -125,7 +241,9 @@ dir_lookup (const struct dir *dir, const char *name,
  * error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
+	struct dir_header h;
 	struct dir_entry e;
+	size_t start, i;
 	off_t ofs;
 	bool success = false;
 
@@ -140,20 +258,50 @@ dir_add (struct dir *dir, const char *name, disk_sector_t inode_sector) {
 	if (lookup (dir, name, NULL, NULL))
 		goto done;
 
-	/* Set OFS to offset of free slot.
-	 * If there are no free slots, then it will be set to the
-	 * current end-of-file.
+	if (!read_header (dir, &h)) {
+		/* Set OFS to offset of free slot.
+		 * If there are no free slots, then it will be set to the
+		 * current end-of-file.
+
+		 * inode_read_at() will only return a short read at end of file.
+		 * Otherwise, we'd need to verify that we didn't get a short
+		 * read due to something intermittent such as low memory. */
+		for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+				ofs += sizeof e)
+			if (e.state != ENTRY_USED)
+				goto write;
+
+		/* Full: append while the directory is small, hash it otherwise. */
+		if (ofs / sizeof e < DIR_LINEAR_MAX || !rehash (dir, DIR_HASH_MIN))
+			goto write;
+		if (!read_header (dir, &h))
+			goto done;
+	}
 
-	 * inode_read_at() will only return a short read at end of file.
-	 * Otherwise, we'd need to verify that we didn't get a short
-	 * read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-			ofs += sizeof e)
-		if (!e.in_use)
+	/* Keep the table at most three quarters full. */
+	if ((h.fill_cnt + 1) * 4 > h.slot_cnt * 3 && rehash (dir, h.slot_cnt * 2))
+		read_header (dir, &h);
+
+	/* Take the first free or deleted slot on NAME's probe sequence. */
+	start = slot_hash (&h, name);
+	for (i = 0; i < h.slot_cnt; i++) {
+		ofs = slot_ofs (&h, start + i);
+		if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+			goto done;
+		if (e.state != ENTRY_USED)
 			break;
+	}
+	if (i == h.slot_cnt)
+		goto done;
+	if (e.state == ENTRY_FREE) {
+		h.fill_cnt++;
+		if (inode_write_at (dir->inode, &h, sizeof h, 0) != sizeof h)
+			goto done;
+	}
 
+write:
 	/* Write slot. */
-	e.in_use = true;
+	e.state = ENTRY_USED;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
@@ -167,6 +315,7 @@ done:
  * which occurs only if there is no file with the given NAME. */
 bool
 dir_remove (struct dir *dir, const char *name) {
+	struct dir_header h;
 	struct dir_entry e;
 	struct inode *inode = NULL;
 	bool success = false;
@@ -184,8 +333,9 @@ dir_remove (struct dir *dir, const char *name) {
 	if (inode == NULL)
 		goto done;
 
-	/* Erase directory entry. */
-	e.in_use = false;
+	/* Erase directory entry. Hashed directories leave a tombstone so
+	 * that probing for names placed after it goes on past it. */
+	e.state = read_header (dir, &h) ? ENTRY_DELETED : ENTRY_FREE;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
 
@@ -207,7 +357,7 @@ dir_readdir (struct dir *dir, char name[NAME_MAX + 1]) {
 
 	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
-		if (e.in_use) {
+		if (e.state == ENTRY_USED) {
 			strlcpy (name, e.name, NAME_MAX + 1);
 			return true;
 		}
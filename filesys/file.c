@@ -3,6 +3,27 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
+
+/* With VM, file data goes through the page cache, which mmap'd pages
+   share with read() and write(). */
+#if defined(VM) && defined(EFILESYS)
+#include "filesys/page_cache.h"
+#define data_read_at page_cache_read
+#define data_write_at page_cache_write
+#else
+#define data_read_at inode_read_at
+#define data_write_at inode_write_at
+#endif
+
+/* Open files, one per open() and per mapping. */
+static struct slab_cache *file_slab;
+
+/* Initializes the file module. */
+void file_init(void)
+{
+	file_slab = slab_cache_create("file", sizeof(struct file), NULL);
+}
 
 /* Opens a file for the given INODE, of which it takes ownership,
  * and returns the new file.  Returns a null pointer if an
@@ -10,7 +31,7 @@
 struct file *
 file_open(struct inode *inode)
 {
-	struct file *file = calloc(1, sizeof *file);
+	struct file *file = slab_alloc(file_slab);
 	if (inode != NULL && file != NULL)
 	{
 		file->inode = inode;
@@ -25,7 +46,7 @@ file_open(struct inode *inode)
 	else
 	{
 		inode_close(inode);
-		free(file);
+		slab_free(file_slab, file);
 		return NULL;
 	}
 }
@@ -63,7 +84,7 @@ void file_close(struct file *file)
 	{
 		file_allow_write(file);
 		inode_close(file->inode);
-		free(file);
+		slab_free(file_slab, file);
 	}
 }
 
@@ -81,7 +102,7 @@ file_get_inode(struct file *file)
  * Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file *file, void *buffer, off_t size)
 {
-	off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+	off_t bytes_read = data_read_at(file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -93,7 +114,7 @@ off_t file_read(struct file *file, void *buffer, off_t size)
  * The file's current position is unaffected. */
 off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
 {
-	return inode_read_at(file->inode, buffer, size, file_ofs);
+	return data_read_at(file->inode, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -105,7 +126,7 @@ off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
  * Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file *file, const void *buffer, off_t size)
 {
-	off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+	off_t bytes_written = data_write_at(file->inode, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -120,7 +141,7 @@ off_t file_write(struct file *file, const void *buffer, off_t size)
 off_t file_write_at(struct file *file, const void *buffer, off_t size,
 					off_t file_ofs)
 {
-	return inode_write_at(file->inode, buffer, size, file_ofs);
+	return data_write_at(file->inode, buffer, size, file_ofs);
 }
 
 /* Prevents write operations on FILE's underlying inode
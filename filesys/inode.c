@@ -1,23 +1,73 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+#ifdef EFILESYS
+/* Data sectors are a chain of clusters in the FAT. Each open inode
+ * remembers where it found every STRIDE'th cluster of its chain, so
+ * a lookup walks at most STRIDE links; STRIDE doubles whenever the
+ * file outgrows CHAIN_MARKS marks. */
+#define CHAIN_MARKS 32
+
+struct chain_cache {
+	uint32_t stride;                    /* Clusters between marks, a power of 2. */
+	cluster_t marks[CHAIN_MARKS];       /* marks[i]: cluster #i*stride, 0 if unknown. */
+	uint32_t last_idx;                  /* Cluster # of the last lookup... */
+	cluster_t last_clst;                /* ...and its cluster, 0 if none. */
+};
+
+/* On-disk inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct inode_disk {
+	off_t length;                       /* File size in bytes. */
+	unsigned magic;                     /* Magic number. */
+	uint32_t sector_cnt;                /* Data sectors allocated. */
+	cluster_t start;                    /* First data cluster, 0 if none. */
+	cluster_t end;                      /* Last data cluster, 0 if none. */
+	uint32_t unused[123];               /* Not used. */
+};
+#else
+/* A run of contiguous data sectors. */
+struct extent {
+	uint32_t file_sector;               /* Index of the first sector in the file. */
+	disk_sector_t start;                /* First data sector on disk. */
+	uint32_t cnt;                       /* Number of sectors. */
+};
+
+#define INLINE_EXTENTS 41               /* Extents in the inode itself. */
+#define OVERFLOW_EXTENTS 42             /* Extents in the overflow block. */
+#define MAX_EXTENTS (INLINE_EXTENTS + OVERFLOW_EXTENTS)
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
-	disk_sector_t start;                /* First data sector. */
 	off_t length;                       /* File size in bytes. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
+	uint32_t sector_cnt;                /* Data sectors allocated. */
+	uint32_t extent_cnt;                /* Extents in use. */
+	disk_sector_t overflow;             /* Overflow extent block, 0 if none. */
+	struct extent extents[INLINE_EXTENTS]; /* First extents, in file order. */
+};
+
+/* Extents that do not fit in the inode.
+ * Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct extent_block {
+	struct extent extents[OVERFLOW_EXTENTS];
+	uint32_t unused[2];                 /* Not used. */
 };
+#endif
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -28,35 +78,290 @@ bytes_to_sectors (off_t size) {
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	disk_sector_t sector;               /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
 	struct inode_disk data;             /* Inode content. */
+	struct rwlock rw;                   /* Orders read() against write(). */
+	struct rwlock grow;                 /* Held for writing while DATA grows. */
+#ifdef EFILESYS
+	struct lock chain_lock;             /* Protects CHAIN. */
+	struct chain_cache chain;           /* Known positions in the chain. */
+#else
+	struct extent_block *overflow;      /* Overflow extents, if any. */
+#endif
 };
 
+#ifdef EFILESYS
+/* Returns cluster #IDX of INODE's chain. */
+static cluster_t
+chain_lookup (struct inode *inode, uint32_t idx) {
+	struct chain_cache *c = &inode->chain;
+	uint32_t cur, k;
+	cluster_t clst;
+
+	ASSERT (idx < inode->data.sector_cnt / SECTORS_PER_CLUSTER);
+
+	lock_acquire (&inode->chain_lock);
+	while (idx / c->stride >= CHAIN_MARKS) {
+		for (k = 0; k < CHAIN_MARKS / 2; k++)
+			c->marks[k] = c->marks[2 * k];
+		for (; k < CHAIN_MARKS; k++)
+			c->marks[k] = 0;
+		c->stride *= 2;
+	}
+	c->marks[0] = inode->data.start;
+
+	/* Start from the closest known cluster at or before IDX. */
+	for (k = idx / c->stride; c->marks[k] == 0; k--)
+		continue;
+	cur = k * c->stride;
+	clst = c->marks[k];
+	if (c->last_clst != 0 && c->last_idx <= idx && c->last_idx > cur) {
+		cur = c->last_idx;
+		clst = c->last_clst;
+	}
+
+	while (cur < idx) {
+		clst = fat_get (clst);
+		cur++;
+		if (cur % c->stride == 0)
+			c->marks[cur / c->stride] = clst;
+	}
+	c->last_idx = idx;
+	c->last_clst = clst;
+	lock_release (&inode->chain_lock);
+	return clst;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+ * INODE.
+ * Returns -1 if INODE does not contain data for a byte at offset
+ * POS. */
+static disk_sector_t
+byte_to_sector (const struct inode *inode, off_t pos) {
+	uint32_t idx;
+
+	ASSERT (inode != NULL);
+	if (pos >= inode->data.length)
+		return -1;
+
+	idx = pos / DISK_SECTOR_SIZE;
+	return cluster_to_sector (chain_lookup ((struct inode *) inode,
+				idx / SECTORS_PER_CLUSTER)) + idx % SECTORS_PER_CLUSTER;
+}
+
+/* Appends clusters to the chain of the file whose inode is DATA, and
+ * zeroes them, until it has at least SECTORS data sectors.
+ * Returns false if the disk fills up first, in which case the
+ * clusters allocated so far stay with the file.
+ * The caller writes DATA back. */
+static bool
+chain_grow (struct inode_disk *data, size_t sectors) {
+	static char zeros[DISK_SECTOR_SIZE];
+
+	while (data->sector_cnt < sectors) {
+		cluster_t clst = fat_create_chain (data->end);
+		size_t i;
+
+		if (clst == 0)
+			return false;
+		if (data->start == 0)
+			data->start = clst;
+		data->end = clst;
+
+		for (i = 0; i < SECTORS_PER_CLUSTER; i++)
+			buffer_cache_write (cluster_to_sector (clst) + i, zeros, 0,
+					DISK_SECTOR_SIZE);
+		data->sector_cnt += SECTORS_PER_CLUSTER;
+	}
+	return true;
+}
+
+/* Releases the chain of the file whose inode is DATA. */
+static void
+chain_release (struct inode_disk *data) {
+	if (data->start != 0)
+		fat_remove_chain (data->start, 0);
+}
+#else
+
+/* Returns extent I of the file whose inode is DATA and whose overflow
+ * extents, if it has more than INLINE_EXTENTS, are in OVERFLOW. */
+static struct extent *
+extent_at (struct inode_disk *data, struct extent_block *overflow, size_t i) {
+	ASSERT (i < MAX_EXTENTS);
+	if (i < INLINE_EXTENTS)
+		return &data->extents[i];
+	ASSERT (overflow != NULL);
+	return &overflow->extents[i - INLINE_EXTENTS];
+}
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) {
+	struct inode_disk *data = (struct inode_disk *) &inode->data;
+	struct extent *e;
+	uint32_t idx;
+	size_t lo, hi;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length)
-		return inode->data.start + pos / DISK_SECTOR_SIZE;
-	else
+	if (pos >= inode->data.length)
 		return -1;
+
+	/* Binary search for the last extent starting at or before IDX. */
+	idx = pos / DISK_SECTOR_SIZE;
+	lo = 0;
+	hi = data->extent_cnt;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (extent_at (data, inode->overflow, mid)->file_sector <= idx)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	e = extent_at (data, inode->overflow, lo);
+	ASSERT (idx - e->file_sector < e->cnt);
+	return e->start + (idx - e->file_sector);
+}
+
+/* Allocates data sectors for the file whose inode is DATA, until it
+ * has at least SECTORS of them, and zeroes them. Extends the last
+ * extent in place while the sectors after it are free, so a file
+ * written sequentially stays contiguous; otherwise adds extents,
+ * each as long as the free map allows. *OVERFLOW is the file's
+ * overflow block, created here when the inline extents run out.
+ * Returns false if the disk or the extent table fills up first, in
+ * which case the sectors allocated so far stay with the file.
+ * The caller writes DATA back; the overflow block is written here. */
+static bool
+extents_grow (struct inode_disk *data, struct extent_block **overflow,
+		size_t sectors) {
+	static char zeros[DISK_SECTOR_SIZE];
+	bool overflow_dirty = false;
+	bool success = true;
+
+	while (data->sector_cnt < sectors) {
+		size_t want = sectors - data->sector_cnt;
+		struct extent *last = data->extent_cnt > 0
+			? extent_at (data, *overflow, data->extent_cnt - 1) : NULL;
+		disk_sector_t start;
+		size_t cnt, i;
+
+		if (last != NULL
+				&& free_map_allocate_at (last->start + last->cnt, want)) {
+			/* Grow the last extent in place. */
+			start = last->start + last->cnt;
+			cnt = want;
+			last->cnt += cnt;
+		} else {
+			/* Start a new extent, as long as the free map allows. */
+			for (cnt = want; cnt > 0; cnt /= 2)
+				if (free_map_allocate (cnt, &start))
+					break;
+			if (cnt > 0 && last != NULL && start == last->start + last->cnt)
+				last->cnt += cnt;
+			else {
+				if (cnt == 0 || data->extent_cnt == MAX_EXTENTS) {
+					if (cnt > 0)
+						free_map_release (start, cnt);
+					success = false;
+					break;
+				}
+				if (data->extent_cnt == INLINE_EXTENTS) {
+					if (*overflow == NULL)
+						*overflow = calloc (1, sizeof **overflow);
+					if (*overflow == NULL
+							|| !free_map_allocate (1, &data->overflow)) {
+						free_map_release (start, cnt);
+						success = false;
+						break;
+					}
+				}
+				*extent_at (data, *overflow, data->extent_cnt) = (struct extent) {
+					.file_sector = data->sector_cnt,
+					.start = start,
+					.cnt = cnt,
+				};
+				data->extent_cnt++;
+			}
+		}
+		if (data->extent_cnt > INLINE_EXTENTS)
+			overflow_dirty = true;
+
+		for (i = 0; i < cnt; i++)
+			buffer_cache_write (start + i, zeros, 0, DISK_SECTOR_SIZE);
+		data->sector_cnt += cnt;
+	}
+
+	if (overflow_dirty)
+		buffer_cache_write (data->overflow, *overflow, 0, DISK_SECTOR_SIZE);
+	return success;
+}
+
+/* Releases every data sector of the file whose inode is DATA, and its
+ * overflow block. */
+static void
+extents_release (struct inode_disk *data, struct extent_block *overflow) {
+	size_t i;
+
+	for (i = 0; i < data->extent_cnt; i++) {
+		struct extent *e = extent_at (data, overflow, i);
+		free_map_release (e->start, e->cnt);
+	}
+	if (data->extent_cnt > INLINE_EXTENTS)
+		free_map_release (data->overflow, 1);
 }
+#endif
 
-/* List of open inodes, so that opening a single inode twice
+/* Open inodes by sector, so that opening a single inode twice
  * returns the same `struct inode'. */
-static struct list open_inodes;
+static struct hash open_inodes;
+
+/* Protects open_inodes and every inode's open_cnt. */
+static struct lock open_inodes_lock;
+
+/* Statistics. */
+static long long open_cnt;              /* Calls to inode_open(). */
+static long long open_hit_cnt;          /* ...that found the inode open. */
+static long long close_cnt;             /* Calls to inode_close(). */
+static size_t peak_open_cnt;            /* Most inodes open at once. */
+
+static uint64_t
+open_inode_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+open_inode_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+		< hash_entry (b, struct inode, elem)->sector;
+}
+
+/* In-memory inodes, which are well past a power of 2 in size. */
+static struct slab_cache *inode_slab;
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	inode_slab = slab_cache_create ("inode", sizeof (struct inode), NULL);
+	hash_init (&open_inodes, open_inode_hash, open_inode_less, NULL);
+	lock_init (&open_inodes_lock);
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void) {
+	printf ("Inodes: %lld opens (%lld already open), %lld closes, "
+			"%zu open at most\n",
+			open_cnt, open_hit_cnt, close_cnt, peak_open_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -77,20 +382,25 @@ inode_create (disk_sector_t sector, off_t length) {
 
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			disk_write (filesys_disk, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[DISK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) 
-					disk_write (filesys_disk, disk_inode->start + i, zeros); 
-			}
+#ifdef EFILESYS
+		if (chain_grow (disk_inode, bytes_to_sectors (length))) {
+			buffer_cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
+			success = true; 
+		} else
+			chain_release (disk_inode);
+#else
+		struct extent_block *overflow = NULL;
+
+		ASSERT (sizeof *overflow == DISK_SECTOR_SIZE);
+		if (extents_grow (disk_inode, &overflow, bytes_to_sectors (length))) {
+			buffer_cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
 			success = true; 
-		} 
+		} else
+			extents_release (disk_inode, overflow);
+		free (overflow);
+#endif
 		free (disk_inode);
 	}
 	return success;
@@ -101,39 +411,71 @@ inode_create (disk_sector_t sector, off_t length) {
  * Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) {
-	struct list_elem *e;
+	struct inode key;
+	struct hash_elem *e;
 	struct inode *inode;
 
+	lock_acquire (&open_inodes_lock);
+	open_cnt++;
+
 	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-			e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode; 
-		}
+	key.sector = sector;
+	e = hash_find (&open_inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		open_hit_cnt++;
+		lock_release (&open_inodes_lock);
+		return inode; 
 	}
 
 	/* Allocate memory. */
-	inode = malloc (sizeof *inode);
+	inode = slab_alloc (inode_slab);
 	if (inode == NULL)
-		return NULL;
+		goto done;
 
 	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	disk_read (filesys_disk, inode->sector, &inode->data);
+	rwlock_init (&inode->rw);
+	rwlock_init (&inode->grow);
+	buffer_cache_read (inode->sector, &inode->data, 0, DISK_SECTOR_SIZE);
+#ifdef EFILESYS
+	lock_init (&inode->chain_lock);
+	memset (&inode->chain, 0, sizeof inode->chain);
+	inode->chain.stride = 1;
+#else
+	inode->overflow = NULL;
+	if (inode->data.extent_cnt > INLINE_EXTENTS) {
+		inode->overflow = malloc (sizeof *inode->overflow);
+		if (inode->overflow == NULL) {
+			slab_free (inode_slab, inode);
+			inode = NULL;
+			goto done;
+		}
+		buffer_cache_read (inode->data.overflow, inode->overflow, 0,
+				DISK_SECTOR_SIZE);
+	}
+#endif
+	hash_insert (&open_inodes, &inode->elem);
+	if (hash_size (&open_inodes) > peak_open_cnt)
+		peak_open_cnt = hash_size (&open_inodes);
+
+done:
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode) {
-	if (inode != NULL)
+	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
+	}
 	return inode;
 }
 
@@ -143,6 +485,13 @@ inode_get_inumber (const struct inode *inode) {
 	return inode->sector;
 }
 
+/* Returns the lock that the read() and write() system calls hold
+ * on INODE, shared for reading and exclusive for writing. */
+struct rwlock *
+inode_get_rwlock (struct inode *inode) {
+	return &inode->rw;
+}
+
 /* Closes INODE and writes it to disk.
  * If this was the last reference to INODE, frees its memory.
  * If INODE was also a removed inode, frees its blocks. */
@@ -153,19 +502,30 @@ inode_close (struct inode *inode) {
 		return;
 
 	/* Release resources if this was the last opener. */
+	lock_acquire (&open_inodes_lock);
+	close_cnt++;
 	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+		/* Remove from open inodes and release lock. */
+		hash_delete (&open_inodes, &inode->elem);
+		lock_release (&open_inodes_lock);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+#ifdef EFILESYS
+			fat_remove_chain (sector_to_cluster (inode->sector), 0);
+			chain_release (&inode->data);
+#else
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-					bytes_to_sectors (inode->data.length)); 
+			extents_release (&inode->data, inode->overflow);
+#endif
 		}
 
-		free (inode); 
-	}
+#ifndef EFILESYS
+		free (inode->overflow);
+#endif
+		slab_free (inode_slab, inode);
+	} else
+		lock_release (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -176,6 +536,23 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
+/* Stores in *SECTORP the sector that holds byte OFFSET of INODE, or -1,
+ * and returns the number of bytes from OFFSET to end of file. Both are
+ * looked up together under INODE's grow lock, so a file growing at the
+ * same time is seen either before or after the growth. No one holds
+ * the lock while touching a caller's buffer, which may fault: a fault
+ * on a mapping of the same file reads it too. */
+static off_t
+inode_locate (struct inode *inode, off_t offset, disk_sector_t *sectorp) {
+	off_t left;
+
+	rwlock_acquire_read (&inode->grow);
+	*sectorp = byte_to_sector (inode, offset);
+	left = inode->data.length - offset;
+	rwlock_release_read (&inode->grow);
+	return left;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
@@ -183,15 +560,14 @@ off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
 
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx;
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = inode_locate (inode, offset, &sector_idx);
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -200,53 +576,64 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+		/* Copy the chunk out of the buffer cache. */
+		buffer_cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
  * Returns the number of bytes actually written, which may be
- * less than SIZE if end of file is reached or an error occurs.
- * (Normally a write at end of file would extend the inode, but
- * growth is not yet implemented.) */
+ * less than SIZE if the disk fills up or an error occurs.
+ * A write past end of file extends the inode; any gap between the
+ * old end of file and OFFSET reads back as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		off_t offset) {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
 
 	if (inode->deny_write_cnt)
 		return 0;
 
+	/* Readers through the page cache and mmap'd pages do not hold the
+	 * inode's rw lock, and neither does writeback; growth keeps them
+	 * out with the grow lock. The length is checked again under it,
+	 * since another writer may have grown the file meanwhile. */
+	if (size > 0 && offset + size > inode->data.length) {
+		off_t length = offset + size;
+
+		rwlock_acquire_write (&inode->grow);
+#ifdef EFILESYS
+		if (!chain_grow (&inode->data, bytes_to_sectors (length))
+#else
+		if (!extents_grow (&inode->data, &inode->overflow,
+					bytes_to_sectors (length))
+#endif
+				&& length > (off_t) inode->data.sector_cnt * DISK_SECTOR_SIZE)
+			length = inode->data.sector_cnt * DISK_SECTOR_SIZE;
+		if (length > inode->data.length) {
+			inode->data.length = length;
+			buffer_cache_write (inode->sector, &inode->data, 0,
+					DISK_SECTOR_SIZE);
+		}
+		rwlock_release_write (&inode->grow);
+	}
+
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
-		disk_sector_t sector_idx = byte_to_sector (inode, offset);
+		disk_sector_t sector_idx;
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		off_t inode_left = inode_locate (inode, offset, &sector_idx);
 		int sector_left = DISK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -255,34 +642,16 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) 
-				disk_read (filesys_disk, sector_idx, bounce);
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			disk_write (filesys_disk, sector_idx, bounce); 
-		}
+		/* Copy the chunk into the buffer cache, which reads the
+		   rest of the sector in first for a partial write. */
+		buffer_cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+				chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
 	return bytes_written;
 }
@@ -306,6 +675,12 @@ inode_allow_write (struct inode *inode) {
 	inode->deny_write_cnt--;
 }
 
+/* Returns true if writes to INODE are currently denied. */
+bool
+inode_is_write_denied (const struct inode *inode) {
+	return inode->deny_write_cnt > 0;
+}
+
 /* Returns the length, in bytes, of INODE's data. */
 off_t
 inode_length (const struct inode *inode) {
@@ -1,9 +1,38 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
 #include "vm/vm.h"
+#ifdef EFILESYS
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* File pages live in user-pool frames that are not in the frame
+ * table: the cache replaces its own pages with a clock of its own,
+ * and hands frames back to the user pool when VM runs short of them.
+ * read(), write() and mmap'd pages all go through here (see file.c),
+ * so a file page is read from disk once whoever asks for it first. */
+
+#define PAGE_CACHE_PAGES 64             /* Most pages the cache holds. */
+#define RA_MAX_PAGES 16                 /* Largest readahead window. */
+#define RA_STREAMS 8                    /* Sequential readers tracked. */
+#define WRITEBACK_TICKS TIMER_FREQ      /* Age at which a dirty page is
+										   written back. */
+#define FLUSH_TICKS (WRITEBACK_TICKS / 2) /* How often the flusher looks. */
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
+static void page_cache_kworkerd (void *aux);
+static void page_cache_flushd (void *aux);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations page_cache_op = {
@@ -15,36 +44,644 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* A sequential reader: where its next read is expected to start, how
+ * many pages to read ahead of it, and how far readahead has been
+ * requested already. */
+struct ra_stream {
+	struct inode *inode;                /* Compared only, not referenced. */
+	off_t next;
+	size_t window;
+	off_t ra_end;
+};
+
+/* Pages of INODE, starting at OFFSET, for the worker to read ahead. */
+struct ra_request {
+	struct inode *inode;                /* Holds a reference. */
+	off_t offset;
+	size_t page_cnt;
+	struct list_elem elem;
+};
+
+static bool pc_ready;                   /* True once pagecache_init ran. */
+static struct lock pc_lock;             /* Protects everything below. */
+static struct condition pc_io_done;     /* Signaled when a page stops being busy. */
+static struct hash pc_map;              /* (inode, offset) -> page. */
+static struct list pc_list;             /* Cached pages, in clock order. */
+static struct list_elem *pc_hand;       /* Next page the clock looks at. */
+static size_t pc_cnt;                   /* Number of cached pages. */
+static struct ra_stream streams[RA_STREAMS];
+static size_t next_stream;              /* Stream slot to recycle next. */
+static struct list ra_queue;            /* Pending ra_requests. */
+static struct semaphore kworkerd_wakeup;
+
+/* Statistics. */
+static long long hit_cnt;               /* Page lookups served from memory. */
+static long long miss_cnt;              /* Page lookups that read the disk. */
+static long long ra_cnt;                /* Pages read ahead by the worker. */
+static long long writeback_cnt;         /* Dirty pages written back. */
+static long long reclaim_cnt;           /* Pages dropped for VM. */
+
+static uint64_t
+pc_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page *p = hash_entry (e, struct page, hash_elem);
+	return hash_bytes (&p->page_cache.inode, sizeof p->page_cache.inode)
+		^ hash_int (p->page_cache.offset);
+}
+
+static bool
+pc_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = &hash_entry (a_, struct page, hash_elem)->page_cache;
+	const struct page_cache *b = &hash_entry (b_, struct page, hash_elem)->page_cache;
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->offset < b->offset;
+}
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
 	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	lock_init (&pc_lock);
+	cond_init (&pc_io_done);
+	hash_init (&pc_map, pc_hash, pc_less, NULL);
+	list_init (&pc_list);
+	pc_hand = NULL;
+	list_init (&ra_queue);
+	sema_init (&kworkerd_wakeup, 0);
+
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	pc_ready = page_cache_workerd != TID_ERROR
+		&& thread_create ("flushd", PRI_DEFAULT, page_cache_flushd, NULL)
+			!= TID_ERROR;
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
-
+	return true;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
+// Fills KVA with the file bytes PAGE caches, zeroing whatever lies past EOF.
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t read = inode_read_at (pc->inode, kva, PGSIZE, pc->offset);
+
+	if (read < 0)
+		return false;
+	memset ((uint8_t *) kva + read, 0, PGSIZE - read);
+	return true;
+}
+
+/* Writes PAGE's bytes to its file. Never grows the file: bytes past
+ * EOF in the page were never part of it. */
+static void
+pc_write_page (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	off_t length = inode_length (pc->inode) - pc->offset;
+
+	if (length > PGSIZE)
+		length = PGSIZE;
+	if (length > 0)
+		inode_write_at (pc->inode, page->frame->kva, length, pc->offset);
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
+// Writes PAGE back if it is dirty.
 static bool
 page_cache_writeback (struct page *page) {
+	if (page->page_cache.dirty) {
+		page->page_cache.dirty = false;
+		pc_write_page (page);
+		writeback_cnt++;
+	}
+	return true;
 }
 
 /* Destory the page_cache. */
 static void
 page_cache_destroy (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	page_cache_writeback (page);
+	palloc_free_page (page->frame->kva);
+	slab_free (frame_slab, page->frame);
+	inode_close (pc->inode);
+}
+
+/* Removes PAGE from the cache and frees it along with its frame. */
+static void
+pc_drop (struct page *page) {
+	struct list_elem *e = &page->page_cache.elem;
+
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+	ASSERT (page->page_cache.pin_cnt == 0);
+	ASSERT (!page->page_cache.busy);
+
+	if (pc_hand == e)
+		pc_hand = list_next (e);
+	list_remove (e);
+	hash_delete (&pc_map, &page->hash_elem);
+	pc_cnt--;
+
+	destroy (page);
+	slab_free (page_slab, page);
+}
+
+/* Writes PAGE back if it is dirty. PAGE is marked busy and pc_lock is
+ * released for the write, so that the rest of the cache stays usable
+ * meanwhile; anyone who wants PAGE waits until it is no longer busy. */
+static void
+pc_writeback (struct page *page) {
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+
+	if (!page->page_cache.dirty || page->page_cache.busy)
+		return;
+
+	/* A write that lands during the transfer dirties it again. */
+	page->page_cache.dirty = false;
+	page->page_cache.busy = true;
+	writeback_cnt++;
+	lock_release (&pc_lock);
+	pc_write_page (page);
+	lock_acquire (&pc_lock);
+	page->page_cache.busy = false;
+	cond_broadcast (&pc_io_done, &pc_lock);
+}
+
+/* Chooses an unpinned, idle page with the clock algorithm, or returns
+ * a null pointer if there is none. */
+static struct page *
+pc_victim (void) {
+	size_t scan;
+
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+
+	for (scan = 0; scan < 2 * pc_cnt; scan++) {
+		struct page *page;
+
+		if (pc_hand == NULL || pc_hand == list_end (&pc_list))
+			pc_hand = list_begin (&pc_list);
+		page = list_entry (pc_hand, struct page, page_cache.elem);
+		pc_hand = list_next (pc_hand);
+
+		if (page->page_cache.pin_cnt > 0 || page->page_cache.busy)
+			continue;
+		if (!page->page_cache.accessed)
+			return page;
+		page->page_cache.accessed = false;
+	}
+	return NULL;
+}
+
+/* Returns a frame for KVA, a new cache page, or a null pointer if
+ * none can be allocated. */
+static struct frame *
+pc_new_frame (void *kva) {
+	struct frame *frame = slab_alloc (frame_slab);
+
+	if (frame == NULL)
+		return NULL;
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->ref_cnt = 0;
+	frame->pinned = true;
+	return frame;
+}
+
+/* Returns the cached page holding OFFSET of INODE, waiting for it if
+ * it is busy, or a null pointer if it is not cached. */
+static struct page *
+pc_find (struct inode *inode, off_t offset) {
+	struct page key;
+	struct hash_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+
+	key.page_cache.inode = inode;
+	key.page_cache.offset = offset;
+	while ((e = hash_find (&pc_map, &key.hash_elem)) != NULL) {
+		struct page *page = hash_entry (e, struct page, hash_elem);
+		if (!page->page_cache.busy)
+			return page;
+		cond_wait (&pc_io_done, &pc_lock);
+	}
+	return NULL;
+}
+
+/* Returns the cached page holding OFFSET of INODE, reading it in if it
+ * is not cached yet, with its pin count raised. Returns a null pointer
+ * if the page cannot be cached. If READAHEAD is true, a page read in
+ * is counted as read ahead rather than as a miss and is left for the
+ * clock to take first.
+ *
+ * A new page takes a fresh user-pool page while the cache is below its
+ * size, otherwise the frame of a page the clock gives up. It is in the
+ * cache, busy, while it is read, and pc_lock is released meanwhile. */
+static struct page *
+pc_get (struct inode *inode, off_t offset, bool readahead) {
+	struct page *page;
+	struct frame *frame;
+	void *kva;
+	bool ok;
+
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+	ASSERT (offset % PGSIZE == 0);
+
+	for (;;) {
+		struct page *victim;
+
+		page = pc_find (inode, offset);
+		if (page != NULL) {
+			hit_cnt++;
+			page->page_cache.accessed = true;
+			page->page_cache.pin_cnt++;
+			return page;
+		}
+
+		if (pc_cnt < PAGE_CACHE_PAGES
+				&& (kva = palloc_get_page (PAL_USER)) != NULL)
+			break;
+		victim = pc_victim ();
+		if (victim == NULL)
+			return NULL;
+		if (victim->page_cache.dirty)
+			pc_writeback (victim);      /* Releases pc_lock: look again. */
+		else
+			pc_drop (victim);
+	}
+
+	page = slab_alloc (page_slab);
+	frame = pc_new_frame (kva);
+	if (page == NULL || frame == NULL) {
+		slab_free (page_slab, page);
+		slab_free (frame_slab, frame);
+		palloc_free_page (kva);
+		return NULL;
+	}
+
+	*page = (struct page) {
+		.frame = frame,
+		.writable = true,
+		.page_cache = (struct page_cache) {
+			.inode = inode_reopen (inode),
+			.offset = offset,
+			.accessed = !readahead,
+			.busy = true,
+			.pin_cnt = 1,
+		},
+	};
+	page_cache_initializer (page, VM_PAGE_CACHE, frame->kva);
+	frame->page = page;
+	hash_insert (&pc_map, &page->hash_elem);
+	list_push_back (&pc_list, &page->page_cache.elem);
+	pc_cnt++;
+
+	lock_release (&pc_lock);
+	ok = swap_in (page, frame->kva);
+	lock_acquire (&pc_lock);
+	page->page_cache.busy = false;
+	cond_broadcast (&pc_io_done, &pc_lock);
+
+	if (!ok) {
+		page->page_cache.pin_cnt = 0;
+		pc_drop (page);
+		return NULL;
+	}
+	frame->pinned = false;
+	if (readahead)
+		ra_cnt++;
+	else
+		miss_cnt++;
+	return page;
+}
+
+/* Drops the pin pc_get() took on PAGE, marking PAGE dirty if DIRTY. */
+static void
+pc_put (struct page *page, bool dirty) {
+	lock_acquire (&pc_lock);
+	ASSERT (page->page_cache.pin_cnt > 0);
+	if (dirty && !page->page_cache.dirty) {
+		page->page_cache.dirty = true;
+		page->page_cache.dirtied = timer_ticks ();
+	}
+	page->page_cache.pin_cnt--;
+	lock_release (&pc_lock);
+}
+
+/* Records a read of INODE from OFFSET up to END and, if it carries on
+ * where the previous one stopped, asks the worker to read the next
+ * window of pages ahead. The window doubles every time the reader
+ * moves on to a page it was not yet read ahead to, and falls back to
+ * nothing on a seek. */
+static void
+pc_note_read (struct inode *inode, off_t offset, off_t end) {
+	struct ra_stream *s = NULL;
+	struct ra_request *req;
+	off_t ra_start, length;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&pc_lock));
+
+	for (i = 0; i < RA_STREAMS; i++)
+		if (streams[i].inode == inode)
+			s = &streams[i];
+	if (s == NULL) {
+		s = &streams[next_stream];
+		next_stream = (next_stream + 1) % RA_STREAMS;
+		*s = (struct ra_stream) { .inode = inode, .next = -1 };
+	}
+
+	if (offset != s->next) {
+		s->next = end;
+		s->window = 0;
+		s->ra_end = 0;
+		return;
+	}
+	s->next = end;
+
+	/* Still reading pages that were read ahead already. */
+	ra_start = ROUND_UP (end, PGSIZE);
+	if (ra_start + (off_t) s->window * PGSIZE / 2 < s->ra_end)
+		return;
+	if (ra_start < s->ra_end)
+		ra_start = s->ra_end;
+
+	length = inode_length (inode);
+	if (ra_start >= length)
+		return;
+	s->window = s->window == 0 ? 1
+		: (s->window * 2 < RA_MAX_PAGES ? s->window * 2 : RA_MAX_PAGES);
+
+	req = malloc (sizeof *req);
+	if (req == NULL)
+		return;
+	req->inode = inode_reopen (inode);
+	req->offset = ra_start;
+	req->page_cnt = s->window;
+	s->ra_end = ra_start + (off_t) s->window * PGSIZE;
+	list_push_back (&ra_queue, &req->elem);
+	sema_up (&kworkerd_wakeup);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+ * OFFSET, through the page cache. Returns the number of bytes
+ * actually read, which is short at end of file. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size,
+		off_t offset) {
+	uint8_t *buffer = buffer_;
+	off_t bytes_read = 0;
+	off_t length;
+
+	if (!pc_ready)
+		return inode_read_at (inode, buffer, size, offset);
+
+	length = inode_length (inode);
+	while (size > 0 && offset < length) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs;
+		struct page *page;
+
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - offset)
+			chunk = length - offset;
+
+		lock_acquire (&pc_lock);
+		page = pc_get (inode, offset - page_ofs, false);
+		lock_release (&pc_lock);
+		if (page == NULL) {
+			/* Could not cache the page: read around the cache. */
+			off_t read = inode_read_at (inode, buffer + bytes_read, chunk, offset);
+			bytes_read += read;
+			if (read != chunk)
+				break;
+		} else {
+			/* The copy may fault on BUFFER, so it runs unlocked. */
+			memcpy (buffer + bytes_read, (uint8_t *) page->frame->kva + page_ofs,
+					chunk);
+			pc_put (page, false);
+			bytes_read += chunk;
+		}
+		size -= chunk;
+		offset += chunk;
+	}
+
+	if (bytes_read > 0) {
+		lock_acquire (&pc_lock);
+		pc_note_read (inode, offset - bytes_read, offset);
+		lock_release (&pc_lock);
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, through
+ * the page cache. Returns the number of bytes actually written.
+ * Writes inside the file only dirty cached pages, which reach the disk
+ * when the worker or the cache's clock writes them back. A write that
+ * reaches past EOF goes to the inode, which decides about growth, and
+ * cached copies are updated to match. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t offset) {
+	const uint8_t *buffer = buffer_;
+	off_t bytes_written = 0;
+
+	if (!pc_ready || offset + size > inode_length (inode)) {
+		bytes_written = inode_write_at (inode, buffer, size, offset);
+		if (pc_ready)
+			for (off_t done = 0; done < bytes_written; ) {
+				off_t page_ofs = (offset + done) % PGSIZE;
+				off_t chunk = PGSIZE - page_ofs;
+				struct page *page;
+
+				if (chunk > bytes_written - done)
+					chunk = bytes_written - done;
+				lock_acquire (&pc_lock);
+				page = pc_find (inode, offset + done - page_ofs);
+				if (page != NULL)
+					page->page_cache.pin_cnt++;
+				lock_release (&pc_lock);
+				if (page != NULL) {
+					/* Dirty, or a writeback of the page's older contents
+					 * racing with ours could be the last to hit the disk. */
+					memcpy ((uint8_t *) page->frame->kva + page_ofs,
+							buffer + done, chunk);
+					pc_put (page, true);
+				}
+				done += chunk;
+			}
+		return bytes_written;
+	}
+
+	if (inode_is_write_denied (inode))
+		return 0;
+
+	while (size > 0) {
+		off_t page_ofs = offset % PGSIZE;
+		off_t chunk = PGSIZE - page_ofs;
+		struct page *page;
+
+		if (chunk > size)
+			chunk = size;
+
+		lock_acquire (&pc_lock);
+		page = pc_get (inode, offset - page_ofs, false);
+		lock_release (&pc_lock);
+		if (page == NULL) {
+			/* Could not cache the page: write around the cache. */
+			off_t written = inode_write_at (inode, buffer + bytes_written,
+					chunk, offset);
+			bytes_written += written;
+			if (written != chunk)
+				break;
+		} else {
+			/* The copy may fault on BUFFER, so it runs unlocked. */
+			memcpy ((uint8_t *) page->frame->kva + page_ofs,
+					buffer + bytes_written, chunk);
+			pc_put (page, true);
+			bytes_written += chunk;
+		}
+		size -= chunk;
+		offset += chunk;
+	}
+	return bytes_written;
+}
+
+/* Writes back every page that has been dirty for at least MIN_AGE
+ * ticks. */
+static void
+pc_flush (int64_t min_age) {
+	struct list_elem *e;
+
+	lock_acquire (&pc_lock);
+	for (e = list_begin (&pc_list); e != list_end (&pc_list); e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, page_cache.elem);
+
+		/* The pin keeps PAGE, and so E, in the list while pc_lock is
+		 * released. */
+		page->page_cache.pin_cnt++;
+		while (page->page_cache.busy)
+			cond_wait (&pc_io_done, &pc_lock);
+		if (page->page_cache.dirty
+				&& timer_elapsed (page->page_cache.dirtied) >= min_age)
+			pc_writeback (page);
+		page->page_cache.pin_cnt--;
+	}
+	lock_release (&pc_lock);
+}
+
+/* Writes every dirty page back. */
+void
+page_cache_flush (void) {
+	if (pc_ready)
+		pc_flush (0);
+}
+
+/* Gives frames back to the user pool by dropping up to half of the
+ * cached pages, writing dirty ones back first. Called by VM when the
+ * user pool runs dry, before it evicts. Returns true if any frame was
+ * freed. */
+bool
+page_cache_reclaim (void) {
+	size_t target, dropped = 0;
+
+	if (!pc_ready)
+		return false;
+
+	lock_acquire (&pc_lock);
+	target = pc_cnt / 2;
+	while (pc_cnt > target) {
+		struct page *victim = pc_victim ();
+		if (victim == NULL)
+			break;
+		if (victim->page_cache.dirty)
+			pc_writeback (victim);
+		else {
+			pc_drop (victim);
+			dropped++;
+		}
+	}
+	reclaim_cnt += dropped;
+	lock_release (&pc_lock);
+	return dropped > 0;
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Page cache: %lld hits, %lld misses, %lld read ahead, "
+			"%lld write-backs, %lld reclaimed\n",
+			hit_cnt, miss_cnt, ra_cnt, writeback_cnt, reclaim_cnt);
+}
+
+/* Reads REQ's pages into the cache. */
+static void
+pc_do_readahead (struct ra_request *req) {
+	size_t i;
+
+	for (i = 0; i < req->page_cnt; i++) {
+		off_t offset = req->offset + (off_t) i * PGSIZE;
+		struct page key, *page;
+
+		if (offset >= inode_length (req->inode))
+			break;
+
+		lock_acquire (&pc_lock);
+		key.page_cache.inode = req->inode;
+		key.page_cache.offset = offset;
+		if (hash_find (&pc_map, &key.hash_elem) == NULL) {
+			page = pc_get (req->inode, offset, true);
+			if (page != NULL)
+				page->page_cache.pin_cnt--;
+		}
+		lock_release (&pc_lock);
+	}
 }
 
 /* Worker thread for page cache */
+// Sleeps until someone queues readahead.
+static void
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kworkerd_wakeup);
+
+		for (;;) {
+			struct ra_request *req = NULL;
+
+			lock_acquire (&pc_lock);
+			if (!list_empty (&ra_queue))
+				req = list_entry (list_pop_front (&ra_queue),
+						struct ra_request, elem);
+			lock_release (&pc_lock);
+			if (req == NULL)
+				break;
+
+			pc_do_readahead (req);
+			inode_close (req->inode);
+			free (req);
+		}
+	}
+}
+
+/* Writeback thread for page cache */
+// Wakes every FLUSH_TICKS and writes back the pages that have been
+// dirty for WRITEBACK_TICKS, so a page written once reaches the disk
+// even if nothing else happens to the cache.
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_flushd (void *aux UNUSED) {
+	for (;;) {
+		timer_sleep (FLUSH_TICKS);
+		pc_flush (WRITEBACK_TICKS);
+	}
 }
+#endif /* EFILESYS */
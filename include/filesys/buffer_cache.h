@@ -0,0 +1,16 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+
+void buffer_cache_init (void);
+void buffer_cache_done (void);
+void buffer_cache_read (disk_sector_t sector, void *buffer, off_t ofs,
+		size_t size);
+void buffer_cache_write (disk_sector_t sector, const void *buffer, off_t ofs,
+		size_t size);
+void buffer_cache_flush (void);
+void buffer_cache_print_stats (void);
+
+#endif /* filesys/buffer_cache.h */
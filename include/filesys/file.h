@@ -15,6 +15,8 @@ struct file
 };
 struct inode;
 
+void file_init(void);
+
 /* Opening and closing files. */
 struct file *
 file_open(struct inode *);
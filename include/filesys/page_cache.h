@@ -1,12 +1,32 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+struct page_cache {
+	struct inode *inode;    /* Cached file; the page holds a reference to it. */
+	off_t offset;           /* Page-aligned offset of the page in the file. */
+	bool dirty;             /* Written since the last writeback. */
+	int64_t dirtied;        /* Tick at which it last became dirty. */
+	bool accessed;          /* Used since the clock hand last passed. */
+	bool busy;              /* Being read in or written back. */
+	int pin_cnt;            /* Readers and writers copying in or out. */
+	struct list_elem elem;  /* Element in the cache's clock list. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+off_t page_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t offset);
+off_t page_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t offset);
+void page_cache_flush (void);
+bool page_cache_reclaim (void);
+void page_cache_print_stats (void);
 #endif
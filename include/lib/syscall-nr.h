@@ -36,6 +36,12 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra: timing. */
+	SYS_CLOCK,                  /* Nanoseconds since boot. */
+
+	/* Extra: virtual memory statistics. */
+	SYS_VMSTAT,                 /* Obtain page fault statistics. */
 };
 
 #endif /* lib/syscall-nr.h */
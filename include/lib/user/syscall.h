@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -50,6 +51,13 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+/* Extra: timing. */
+int64_t clock_ns (void);
+
+/* Extra: virtual memory statistics (see <vmstat.h>). */
+struct vmstat;
+bool vmstat (struct vmstat *);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
@@ -78,4 +86,12 @@ get_fs_disk_write_cnt (void) {
 	return write_cnt;
 }
 
+static inline long long
+get_frame_alloc_cnt (void) {
+	long long frame_cnt;
+	asm volatile ("int $0x45");
+	asm volatile ("\t movq %%rax, %0": "=r" (frame_cnt));
+	return frame_cnt;
+}
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,45 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Virtual memory statistics, shared by the kernel and the vmstat
+   system call. */
+
+/* Event counters, kept for each process and for the system. */
+enum vmstat_counter {
+	VMSTAT_MINOR_FAULTS,        /* Faults resolved without I/O. */
+	VMSTAT_MAJOR_FAULTS,        /* Faults that read a file or swap. */
+	VMSTAT_STACK_GROWTHS,       /* Stack pages added by a fault. */
+	VMSTAT_EVICTIONS,           /* Frames taken from another page. */
+	VMSTAT_SWAP_INS,            /* Anonymous pages read from swap. */
+	VMSTAT_SWAP_OUTS,           /* Anonymous pages written to swap. */
+	VMSTAT_FILE_WRITEBACKS,     /* Dirty mapped pages written back. */
+	VMSTAT_COUNTER_CNT
+};
+
+/* Kinds of page fault. */
+enum vmstat_fault {
+	VMSTAT_FAULT_ZERO,          /* Read mapped the shared zero page. */
+	VMSTAT_FAULT_ANON,          /* Zero-filled a new anonymous page. */
+	VMSTAT_FAULT_COW,           /* Write to a page shared by fork. */
+	VMSTAT_FAULT_EXEC,          /* Loaded a page of the executable. */
+	VMSTAT_FAULT_FILE,          /* Loaded a page of a mapped file. */
+	VMSTAT_FAULT_SWAP,          /* Read an anonymous page from swap. */
+	VMSTAT_FAULT_CNT
+};
+
+/* Number of buckets in a fault latency histogram.  Bucket 0
+   counts faults that took under 1 us, bucket I > 0 those that
+   took from 2**(I - 1) up to 2**I us, and the last bucket also
+   everything slower. */
+#define VMSTAT_BUCKETS 16
+
+struct vmstat {
+	long long proc[VMSTAT_COUNTER_CNT];   /* Calling process. */
+	long long global[VMSTAT_COUNTER_CNT]; /* All processes since boot. */
+
+	/* All processes since boot, by kind of fault. */
+	long long faults[VMSTAT_FAULT_CNT];
+	long long latency[VMSTAT_FAULT_CNT][VMSTAT_BUCKETS];
+};
+
+#endif /* lib/vmstat.h */
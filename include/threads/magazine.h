@@ -0,0 +1,35 @@
+#ifndef THREADS_MAGAZINE_H
+#define THREADS_MAGAZINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of rounds a magazine holds. */
+#define MAG_ROUNDS 32
+
+/* Number of rounds moved at once between a magazine and the
+   allocator behind it. */
+#define MAG_BATCH (MAG_ROUNDS / 2)
+
+/* A magazine: a small per-CPU stack of freed blocks, or
+   "rounds", that are handed out again without going back to the
+   allocator they came from.  A zeroed magazine is empty.  Only
+   touch one with interrupts off. */
+struct magazine {
+	size_t round_cnt;           /* Number of rounds loaded. */
+	void *rounds[MAG_ROUNDS];   /* Rounds, most recently freed last. */
+
+	/* Statistics. */
+	long long hit_cnt;          /* Allocations served from here. */
+	long long miss_cnt;         /* Allocations that found it empty. */
+};
+
+/* Set to false by the "-nomag" kernel option. */
+extern bool magazines_enabled;
+
+void *magazine_pop (struct magazine *);
+bool magazine_push (struct magazine *, void *);
+size_t magazine_unload (struct magazine *, void **rounds, size_t cnt);
+void magazine_print_stats (const char *name, const struct magazine *);
+
+#endif /* threads/magazine.h */
@@ -14,10 +14,18 @@ enum palloc_flags {
 /* Maximum number of pages to put in user pool. */
 extern size_t user_page_limit;
 
+/* How pages are found, selected with the "-palloc" kernel option. */
+enum palloc_policy {
+	PALLOC_BUDDY,   /* Buddy free lists, falling back to the bitmap. */
+	PALLOC_BITMAP,  /* First fit in the bitmap only. */
+};
+extern enum palloc_policy palloc_policy;
+
 uint64_t palloc_init (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -0,0 +1,19 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Initializes an object just allocated from a cache. */
+typedef void slab_ctor_func (void *obj);
+
+struct slab_cache;
+
+struct slab_cache *slab_cache_create (const char *name, size_t size,
+		slab_ctor_func *);
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (struct slab_cache *, void *);
+bool slab_owns (const void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
@@ -1,14 +1,18 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include "threads/interrupt.h"
+
+struct thread;
 
 /* A counting semaphore. */
 struct semaphore
 {
 	unsigned value;		 /* Current value. */
-	struct list waiters; /* List of waiting threads. */
+	struct heap waiters; /* Waiting threads, highest priority on top. */
 };
 
 void sema_init(struct semaphore *, unsigned value);
@@ -16,12 +20,15 @@ void sema_down(struct semaphore *);
 bool sema_try_down(struct semaphore *);
 void sema_up(struct semaphore *);
 void sema_self_test(void);
+void sema_reprioritize(struct semaphore *, struct thread *);
 
 /* Lock. */
 struct lock
 {
 	struct thread *holder;		/* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct heap_elem elem;		/* Element in the holder's 'donor_locks'. */
+	int max_prior;				/* Top waiter's priority while donating, else -1. */
 };
 
 void lock_init(struct lock *);
@@ -41,6 +48,33 @@ void cond_wait(struct condition *, struct lock *);
 void cond_signal(struct condition *, struct lock *);
 void cond_broadcast(struct condition *, struct lock *);
 
+/* Reader-writer lock. */
+struct rwlock
+{
+	struct lock gate;		   /* Held by the writer, briefly by entering readers. */
+	struct semaphore drained; /* Upped when the last reader leaves for a writer. */
+	int readers;			   /* Number of readers inside. */
+	bool writer_waiting;	   /* True while the writer waits for readers to leave. */
+};
+
+void rwlock_init(struct rwlock *);
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+
+/* Spin lock, for short critical sections shared between CPUs. */
+struct spinlock
+{
+	volatile int locked;		/* Nonzero while held. */
+	enum intr_level old_level; /* Interrupt level to restore on release. */
+};
+
+void spin_lock_init(struct spinlock *);
+void spin_lock(struct spinlock *);
+void spin_unlock(struct spinlock *);
+bool spin_lock_held(const struct spinlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
@@ -81,11 +81,12 @@ typedef int tid_t;
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
- * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+ * the run queue (thread.c), or it can be an element in the sleep
+ * wheel (thread.c).  It can be used these two ways only because
+ * they are mutually exclusive: only a thread in the ready state
+ * is on the run queue, whereas only a sleeping thread is in the
+ * wheel.  A thread blocked on a semaphore sits in the semaphore's
+ * waiter heap through `w_elem' instead (synch.c). */
 struct thread
 {
 	/* Owned by thread.c. */
@@ -93,19 +94,24 @@ struct thread
 	enum thread_status status; /* Thread state. */
 	char name[16];			   /* Name (for debugging purposes). */
 	int priority;			   /* Priority. */
+	struct cpu *cpu;		   /* CPU whose ready queues hold it. */
 
 	/* Project 1 */
-	int endTick; // 1-1 Alarm clock
+	int64_t endTick; // 1-1 Alarm clock
 
 	// 1-3 Priority donation
 	int basePrior, donatedPrior;
-	struct lock *waiting_lock; // 1-3 lock waiting for (nested-donation)
-	struct list donors;		   // 1-3 remember the donors (multiple-donation)
-	struct list_elem d_elem;   //1-3 used to put thread into 'donors' list
+	struct lock *waiting_lock;		// 1-3 lock waiting for (nested-donation)
+	struct heap donor_locks;		// 1-3 held locks with waiters, keyed by their top waiter (multiple-donation)
+	struct semaphore *waiting_sema; // semaphore whose 'waiters' heap holds this thread
+	struct heap_elem w_elem;		// used to put thread into a semaphore's 'waiters' heap
+	int64_t wait_seq;				// keeps equal-priority waiters in FIFO order
 
 	// 1-4 MLFQS
 	int nice;
 	int recent_cpu;
+	bool mlfqs_dirty;			 // recent_cpu changed since priority was computed
+	struct list_elem mlfqs_elem; // used to put thread into 'mlfqs_dirty_list'
 
 	/* Project 2 */
 	// 2-3 Parent-child hierarchy
@@ -129,7 +135,10 @@ struct thread
 	int stdout_count;
 
 	/* Shared between thread.c and synch.c. */
-	struct list_elem elem; // used to put thread into 'ready_list' or sync blocked_list
+	struct list_elem elem; // used to put thread into a ready queue or sync blocked_list
+
+	/* Owned by thread.c. */
+	struct list_elem all_elem; /* List element for all threads list. */
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
@@ -138,6 +147,7 @@ struct thread
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
 	struct supplemental_page_table spt;
+	long long vm_counters[VMSTAT_COUNTER_CNT]; /* VM events of this process (vm.c). */
 #endif
 
 	// Project 3-2 stack growth
@@ -179,18 +189,18 @@ void do_iret(struct intr_frame *tf);
 
 /* Project 1 */
 // 1-1 Alarm clock
-bool prior_cmp(const struct list_elem *a, const struct list_elem *b, void *aux);
-bool endTick_prior_cmp(const struct list_elem *a, const struct list_elem *b, void *aux);
-void sleep(void);	   // 1-1 Alarm clock
-int64_t wake_up(void); // 1-1 Alarm clock
+void sleep(void);			 // 1-1 Alarm clock
+void wake_up(int64_t now); // 1-1 Alarm clock
+int64_t thread_next_wakeup(int64_t limit);
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
 // 1-3 Priority donation
-void donateNested(struct thread *t, int new_prior); // start from thread newly added to the end of nested lock
-void donateMultiple(struct thread *curr);			// start from core thread getting donation (search through list 'donor')
+void thread_change_priority(struct thread *t, int new_prior); // requeue if ready
+void donateMultiple(struct thread *t);						 // recompute T's donation from the top of 'donor_locks'
 
 // 1-4 Advanced scheduler
+void thread_charge_recentcpu();
 void total_update_recentcpu();
 void thread_update_recentcpu(struct thread *t);
 void update_load_avg();
@@ -12,6 +12,8 @@ struct anon_page {
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_share_swap (struct page *dst, struct page *src);
+void anon_print_stats (void);
 
 struct bitmap *swap_table; // 0 - empty, 1 - filled
 int bitcnt;
@@ -4,6 +4,7 @@
 #include "threads/palloc.h"
 
 #include <hash.h>
+#include <vmstat.h>
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include <list.h>
@@ -55,6 +56,8 @@ struct page {
 	struct hash_elem hash_elem; /* Hash table element for SPT */
 	bool writable; // 'vm_try_handler' needs to find out if the page is writable or read-only
 	int page_cnt; // only for file-mapped pages
+	struct thread *owner; // process whose pml4 maps this page (eviction may run in another process)
+	struct list_elem frame_elem; // Project 3 - Copy-on-write : element of frame->pages
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -71,12 +74,30 @@ struct page {
 /* The representation of "frame" */
 struct frame {
 	void *kva;
-	struct page *page;
+	struct page *page;     // first page in 'pages', NULL if the frame is free
 	struct list_elem elem; // Project 3 - frame table list element
+
+	// Project 3 - Copy-on-write
+	struct list pages;     // every page mapping this frame; more than one only after fork
+	int ref_cnt;           // list_size (&pages)
+	bool pinned;           // held by a fault or an eviction in progress; never a victim
 };
 
 struct list frame_table; // Project 3 - frame table
 
+/* Frame eviction policy, selected with the "-evict" kernel option. */
+enum evict_policy {
+	EVICT_CLOCK,	/* Second chance: skip frames whose accessed bit is set. */
+	EVICT_FIFO,	/* Evict frames in the order they were handed out. */
+};
+extern enum evict_policy evict_policy;
+
+/* Object caches for struct page and struct frame (threads/slab.c).
+ * Pages and frames are allocated on every fault; caching them keeps
+ * them at their own size instead of malloc's next power of 2. */
+struct slab_cache *page_slab;
+struct slab_cache *frame_slab;
+
 /* The function table for page operations.
  * This is one way of implementing "interface" in C.
  * Put the table of "method" into the struct's member, and
@@ -99,6 +120,7 @@ struct page_operations {
 struct supplemental_page_table {
     struct hash spt_hash;
 	// 22Oct21 Design - key : page->va, value : struct page
+	size_t swap_cursor; // Project 3 - swap slot to try first for this process's next evicted page
 };
 
 #include "threads/thread.h"
@@ -112,6 +134,11 @@ bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
 
 void vm_init (void);
+void vm_print_stats (void);
+void vm_stat_count (enum vmstat_counter);
+void vm_get_stats (struct vmstat *);
+void frame_link (struct frame *frame, struct page *page);
+void frame_unlink (struct page *page);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -0,0 +1,10 @@
+#ifndef VM_ZERO_H
+#define VM_ZERO_H
+
+void vm_zero_init (void);
+void *zero_page (void);
+void *zero_pool_get (void);
+void zero_pool_kick (void);
+void zero_print_stats (void);
+
+#endif
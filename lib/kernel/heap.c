@@ -0,0 +1,153 @@
+/* Priority queue.
+
+   See heap.h for basic information. */
+
+#include "heap.h"
+#include "../debug.h"
+
+static struct heap_elem *meld (struct heap *,
+		struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap that compares elements using
+   LESS, given auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = h->root != NULL ? meld (h, h->root, e) : e;
+	h->elem_cnt++;
+}
+
+/* Removes the greatest element of H and returns it.  If several
+   elements are equally great, which of them is returned is
+   unspecified.  Undefined behavior if H is empty. */
+struct heap_elem *
+heap_pop (struct heap *h) {
+	struct heap_elem *top = heap_top (h);
+	heap_remove (h, top);
+	return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+	ASSERT (h->elem_cnt > 0);
+
+	struct heap_elem *sub = merge_pairs (h, e->child);
+	if (e == h->root)
+		h->root = sub;
+	else {
+		/* Unlink E from its parent's child list. */
+		if (e->prev->child == e)
+			e->prev->child = e->next;
+		else
+			e->prev->next = e->next;
+		if (e->next != NULL)
+			e->next->prev = e->prev;
+		if (sub != NULL)
+			h->root = meld (h, h->root, sub);
+	}
+	h->elem_cnt--;
+}
+
+/* Restores the heap order of H after the key of E, which must be
+   in H, has changed. */
+void
+heap_update (struct heap *h, struct heap_elem *e) {
+	heap_remove (h, e);
+	heap_push (h, e);
+}
+
+/* Returns the greatest element of H.  Undefined behavior if H is
+   empty. */
+struct heap_elem *
+heap_top (const struct heap *h) {
+	ASSERT (h != NULL);
+	ASSERT (h->root != NULL);
+	return h->root;
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (const struct heap *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+heap_empty (const struct heap *h) {
+	return h->elem_cnt == 0;
+}
+
+/* Joins the trees rooted at A and B, neither of which has a
+   parent or siblings, and returns the root of the result. */
+static struct heap_elem *
+meld (struct heap *h, struct heap_elem *a, struct heap_elem *b) {
+	if (h->less (a, b, h->aux)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	/* B becomes the leftmost child of A. */
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->next = a->prev = NULL;
+	return a;
+}
+
+/* Joins the sibling list starting at FIRST into a single tree
+   and returns its root, or NULL if FIRST is NULL.  Siblings are
+   melded in pairs from left to right, then the pairs from right
+   to left, which is what keeps pops O(log n) amortized. */
+static struct heap_elem *
+merge_pairs (struct heap *h, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+
+	/* First pass: meld neighbours, stacking the results on PAIRS
+	   through their `next' members. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+		struct heap_elem *rest = b != NULL ? b->next : NULL;
+
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			b->next = b->prev = NULL;
+			a = meld (h, a, b);
+		}
+		a->next = pairs;
+		pairs = a;
+		first = rest;
+	}
+
+	/* Second pass: meld the stack into one tree, last pair first. */
+	struct heap_elem *root = NULL;
+	while (pairs != NULL) {
+		struct heap_elem *a = pairs;
+		pairs = a->next;
+		a->next = NULL;
+		root = root != NULL ? meld (h, root, a) : a;
+	}
+	return root;
+}
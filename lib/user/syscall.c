@@ -194,3 +194,13 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+int64_t
+clock_ns (void) {
+	return syscall0 (SYS_CLOCK);
+}
+
+bool
+vmstat (struct vmstat *st) {
+	return syscall1 (SYS_VMSTAT, st);
+}
@@ -0,0 +1,44 @@
+/* Creates 5,000 empty files in the root directory, then opens
+   each of them by name, and reports how many disk reads each
+   phase takes.  A directory that has to be scanned entry by entry
+   makes both phases quadratic in the number of files. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 5000
+
+void
+test_main (void) 
+{
+  char name[16];
+  long long read_cnt;
+  int i;
+
+  msg ("create %d files", FILE_CNT);
+  read_cnt = get_fs_disk_read_cnt ();
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+  msg ("%lld disk reads creating", get_fs_disk_read_cnt () - read_cnt);
+
+  msg ("open %d files", FILE_CNT);
+  read_cnt = get_fs_disk_read_cnt ();
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+  msg ("%lld disk reads looking up", get_fs_disk_read_cnt () - read_cnt);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/disk reads (creating|looking up)$/, 2,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-dir-lookup) begin
+(lg-dir-lookup) create 5000 files
+(lg-dir-lookup) open 5000 files
+(lg-dir-lookup) end
+EOF
+pass;
@@ -44,4 +44,12 @@ test_main (void) {
 
   msg ("close \"%s\"", file_name);
   close (fd);
+
+  /* Everything the file touched is still cached, so reopening and
+     rereading it must not go to the disk at all. */
+  read_cnt = get_fs_disk_read_cnt();
+  CHECK ((fd = open (file_name)) > 1, "reopen \"%s\"", file_name);
+  CHECK (read (fd, buf, sizeof buf) == sizeof buf, "reread \"%s\"", file_name);
+  CHECK (get_fs_disk_read_cnt() == read_cnt, "check reread read_cnt");
+  close (fd);
 }
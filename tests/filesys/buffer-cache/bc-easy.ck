@@ -10,6 +10,9 @@ check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
 (bc-easy) check read_cnt
 (bc-easy) check write_cnt
 (bc-easy) close "data"
+(bc-easy) reopen "data"
+(bc-easy) reread "data"
+(bc-easy) check reread read_cnt
 (bc-easy) end
 EOF
 pass;
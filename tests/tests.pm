@@ -33,6 +33,23 @@ sub check_expected {
     compare_output ("run", @options, \@output, $expected);
 }
 
+# Like check_expected, but first sets aside the lines of output that
+# match REPORT.  Those report a measurement, such as a run time or a
+# count of disk reads, that varies with the machine or the kernel and
+# so cannot be compared; there must be exactly COUNT of them.
+sub check_expected_with_reports {
+    my ($expected) = pop @_;
+    my ($report, $count, @options) = @_;
+    my (@output) = read_text_file ("$test.output");
+    common_checks ("run", @output);
+
+    my ($found) = scalar (grep (/$report/, @output));
+    fail "Expected $count measurement report(s) in output, found $found.\n"
+      if $found != $count;
+    @output = grep (!/$report/, @output);
+    compare_output ("run", @options, \@output, $expected);
+}
+
 sub common_checks {
     my ($run, @output) = @_;
 
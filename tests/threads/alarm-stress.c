@@ -0,0 +1,84 @@
+/* Puts 2,000 threads to sleep at once, each for a random number
+   of ticks spanning several levels of the sleep queue, and checks
+   that none of them wakes up early.  Also reports the longest
+   time the timer interrupt handler ran with interrupts off while
+   the sleepers were being woken. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 2000
+#define MAX_TICKS 1000
+
+/* One sleeping thread. */
+struct sleeper
+  {
+    int64_t duration;           /* Ticks to sleep. */
+    int64_t deadline;           /* Earliest tick to wake up at. */
+    int64_t woke;               /* Tick actually woken up at. */
+  };
+
+static struct semaphore done;
+static thread_func sleeper;
+
+void
+test_alarm_stress (void) 
+{
+  struct sleeper *sleepers;
+  int early = 0;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sleepers = malloc (sizeof *sleepers * THREAD_CNT);
+  if (sleepers == NULL)
+    PANIC ("couldn't allocate memory for test");
+
+  msg ("Creating %d threads to sleep up to %d ticks each.",
+       THREAD_CNT, MAX_TICKS);
+  random_init (0);
+  sema_init (&done, 0);
+  timer_reset_max_latency ();
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      sleepers[i].duration = random_ulong () % MAX_TICKS + 1;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, &sleepers[i]) == TID_ERROR)
+        fail ("thread_create failed for thread %d", i);
+    }
+
+  /* Wait for every sleeper to wake up. */
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  msg ("All %d threads woke up.", THREAD_CNT);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (sleepers[i].woke < sleepers[i].deadline)
+      early++;
+  if (early != 0)
+    fail ("%d threads woke up before their deadline", early);
+  msg ("No thread woke up early.");
+
+  msg ("Longest timer interrupt: %"PRId64" ns.", timer_max_latency ());
+  free (sleepers);
+}
+
+static void
+sleeper (void *s_) 
+{
+  struct sleeper *s = s_;
+
+  s->deadline = timer_ticks () + s->duration;
+  timer_sleep (s->duration);
+  s->woke = timer_ticks ();
+  sema_up (&done);
+}
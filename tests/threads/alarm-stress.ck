@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/Longest timer interrupt: \d+ ns\.$/, 1,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(alarm-stress) begin
+(alarm-stress) Creating 2000 threads to sleep up to 1000 ticks each.
+(alarm-stress) All 2000 threads woke up.
+(alarm-stress) No thread woke up early.
+(alarm-stress) end
+EOF
+pass;
@@ -0,0 +1,132 @@
+/* Has four threads allocate and free a million small blocks
+   between them, mixed with single pages, while the timer
+   preempts them at random points.  Checks that no block is
+   handed out twice, by stamping each block and checking the
+   stamp when it is freed, and reports how long the run takes,
+   which is dominated by the cost of malloc(), free() and the
+   page allocator's single-page path. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 4
+#define ALLOC_CNT 1000000
+#define SLOT_CNT 16
+#define PAGE_INTERVAL 64
+
+/* A live block and the stamp written into it. */
+struct slot
+  {
+    unsigned char *block;
+    size_t size;
+    unsigned char stamp;
+  };
+
+struct worker
+  {
+    int id;                     /* Thread number. */
+    struct slot slots[SLOT_CNT];
+    int bad_cnt;                /* Blocks found with a wrong stamp. */
+  };
+
+static struct worker workers[THREAD_CNT];
+static struct semaphore done;
+
+static thread_func alloc_thread;
+
+void
+test_alloc_bench (void) 
+{
+  int64_t start;
+  int i;
+
+  sema_init (&done, 0);
+
+  start = timer_now_ns ();
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+
+      workers[i].id = i;
+      snprintf (name, sizeof name, "alloc %d", i);
+      thread_create (name, PRI_DEFAULT, alloc_thread, &workers[i]);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  msg ("%d threads made %d allocations in %"PRId64" us.",
+       THREAD_CNT, ALLOC_CNT, (timer_now_ns () - start) / 1000);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (workers[i].bad_cnt != 0)
+      fail ("thread %d found %d overwritten blocks",
+            i, workers[i].bad_cnt);
+  msg ("Every block kept its contents.");
+}
+
+/* Returns true if BLOCK, of SIZE bytes, still holds STAMP at
+   both ends. */
+static bool
+stamp_intact (const unsigned char *block, size_t size, unsigned char stamp) 
+{
+  return block[0] == stamp && block[size - 1] == stamp;
+}
+
+static void
+alloc_thread (void *w_) 
+{
+  struct worker *w = w_;
+  unsigned seed = w->id * 2654435761u + 1;
+  int i, j;
+
+  for (i = 0; i < ALLOC_CNT / THREAD_CNT; i++) 
+    {
+      struct slot *s;
+
+      seed = seed * 1103515245 + 12345;
+      s = &w->slots[(seed >> 16) % SLOT_CNT];
+
+      /* Replace the block in a random slot with one of a random
+         size between 16 and 512 bytes. */
+      if (s->block != NULL) 
+        {
+          if (!stamp_intact (s->block, s->size, s->stamp))
+            w->bad_cnt++;
+          free (s->block);
+        }
+      s->size = 16 << ((seed >> 8) % 6);
+      s->stamp = w->id * SLOT_CNT + (s - w->slots);
+      s->block = malloc (s->size);
+      if (s->block == NULL)
+        fail ("out of memory after %d allocations", i);
+      memset (s->block, s->stamp, s->size);
+
+      /* Every so often, cycle a page too. */
+      if (i % PAGE_INTERVAL == 0) 
+        {
+          unsigned char *page = palloc_get_page (PAL_ASSERT);
+          memset (page, s->stamp, PGSIZE);
+          thread_yield ();
+          if (!stamp_intact (page, PGSIZE, s->stamp))
+            w->bad_cnt++;
+          palloc_free_page (page);
+        }
+    }
+
+  for (j = 0; j < SLOT_CNT; j++) 
+    {
+      struct slot *s = &w->slots[j];
+      if (s->block != NULL && !stamp_intact (s->block, s->size, s->stamp))
+        w->bad_cnt++;
+      free (s->block);
+    }
+  sema_up (&done);
+}
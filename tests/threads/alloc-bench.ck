@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/allocations in \d+ us\.$/, 1,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(alloc-bench) begin
+(alloc-bench) Every block kept its contents.
+(alloc-bench) end
+EOF
+pass;
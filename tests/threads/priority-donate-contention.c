@@ -0,0 +1,126 @@
+/* A larger priority-donate-multiple: a holder thread takes eight
+   locks and then blocks, while 256 higher-priority threads, each
+   priority band belonging to one lock, pile up waiting on them.
+   The donation reaching the holder must be the highest waiter's,
+   each release must drop the holder to the best remaining lock,
+   and every lock must be handed to its waiters strictly by
+   priority, first come first served among equal priorities.
+   Reports how long the releases take, which is dominated by the
+   cost of finding donors and waking waiters. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define LOCK_CNT 8
+#define WAITER_CNT 256
+#define PRIORITY_BAND ((PRI_MAX - PRI_DEFAULT) / LOCK_CNT)
+
+struct waiter
+  {
+    int lock;                   /* Index of the lock to wait on. */
+    int id;                     /* Creation order. */
+  };
+
+static struct lock locks[LOCK_CNT];
+static struct waiter waiters[WAITER_CNT];
+static struct semaphore go;
+
+/* Per lock: who got it last, and how many waiters got it. */
+static int last_priority[LOCK_CNT];
+static int last_id[LOCK_CNT];
+static int ran_cnt[LOCK_CNT];
+
+static int64_t release_ns;
+
+static thread_func holder_thread;
+static thread_func waiter_thread;
+
+void
+test_priority_donate_contention (void) 
+{
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  for (i = 0; i < LOCK_CNT; i++) 
+    {
+      lock_init (&locks[i]);
+      last_priority[i] = PRI_MAX + 1;
+      last_id[i] = -1;
+    }
+  sema_init (&go, 0);
+
+  /* Get out of the way, so that each new thread runs until it
+     blocks. */
+  thread_set_priority (PRI_MIN);
+  thread_create ("holder", PRI_DEFAULT, holder_thread, NULL);
+
+  /* Lock I gets the priorities of band I, created out of order. */
+  for (i = 0; i < WAITER_CNT; i++) 
+    {
+      struct waiter *w = &waiters[i];
+      char name[16];
+
+      w->lock = i % LOCK_CNT;
+      w->id = i;
+      snprintf (name, sizeof name, "waiter %d", i);
+      thread_create (name, PRI_DEFAULT + 1 + w->lock * PRIORITY_BAND
+                     + (i / LOCK_CNT * 3) % PRIORITY_BAND,
+                     waiter_thread, w);
+    }
+  msg ("%d threads wait on %d locks.", WAITER_CNT, LOCK_CNT);
+
+  sema_up (&go);
+  msg ("Handed off %d locks in %"PRId64" us.", LOCK_CNT, release_ns / 1000);
+  thread_set_priority (PRI_DEFAULT);
+}
+
+static void
+holder_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < LOCK_CNT; i++)
+    lock_acquire (&locks[i]);
+  sema_down (&go);
+
+  msg ("Holder should have priority %d.  Actual priority: %d.",
+       PRI_MAX, thread_get_priority ());
+  for (i = LOCK_CNT - 1; i >= 0; i--) 
+    {
+      int64_t start = timer_now_ns ();
+      lock_release (&locks[i]);
+      release_ns += timer_now_ns () - start;
+      msg ("Lock %d: %d of %d waiters ran, holder priority %d.",
+           i, ran_cnt[i], WAITER_CNT / LOCK_CNT, thread_get_priority ());
+    }
+}
+
+static void
+waiter_thread (void *w_) 
+{
+  struct waiter *w = w_;
+  int priority;
+
+  lock_acquire (&locks[w->lock]);
+  priority = thread_get_priority ();
+  if (priority > last_priority[w->lock])
+    fail ("lock %d went to priority %d after priority %d",
+          w->lock, priority, last_priority[w->lock]);
+  if (priority == last_priority[w->lock] && w->id < last_id[w->lock])
+    fail ("lock %d went to thread %d after thread %d",
+          w->lock, w->id, last_id[w->lock]);
+  last_priority[w->lock] = priority;
+  last_id[w->lock] = w->id;
+  ran_cnt[w->lock]++;
+  lock_release (&locks[w->lock]);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/Handed off \d+ locks in \d+ us\.$/, 1,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(priority-donate-contention) begin
+(priority-donate-contention) 256 threads wait on 8 locks.
+(priority-donate-contention) Holder should have priority 63.  Actual priority: 63.
+(priority-donate-contention) Lock 7: 32 of 32 waiters ran, holder priority 59.
+(priority-donate-contention) Lock 6: 32 of 32 waiters ran, holder priority 55.
+(priority-donate-contention) Lock 5: 32 of 32 waiters ran, holder priority 51.
+(priority-donate-contention) Lock 4: 32 of 32 waiters ran, holder priority 47.
+(priority-donate-contention) Lock 3: 32 of 32 waiters ran, holder priority 43.
+(priority-donate-contention) Lock 2: 32 of 32 waiters ran, holder priority 39.
+(priority-donate-contention) Lock 1: 32 of 32 waiters ran, holder priority 35.
+(priority-donate-contention) Lock 0: 32 of 32 waiters ran, holder priority 31.
+(priority-donate-contention) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* The main thread reads under a reader-writer lock.  A writer
+   then blocks waiting for the main thread to finish, and a
+   higher-priority reader arrives after it.  The reader must not
+   overtake the waiting writer, and must instead donate its
+   priority to it, so the writer writes at the reader's priority
+   and the reader reads right after. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+
+void
+test_priority_donate_rwlock (void) 
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rw);
+  rwlock_acquire_read (&rw);
+  msg ("main: reading.");
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread_func, &rw);
+  msg ("main: writer is waiting.");
+  thread_create ("reader", PRI_DEFAULT + 4, reader_thread_func, &rw);
+  msg ("main: reader is waiting behind the writer.");
+  rwlock_release_read (&rw);
+  msg ("main: writer and reader must already have finished.");
+}
+
+static void
+writer_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_acquire_write (rw);
+  msg ("writer: writing at priority %d.", thread_get_priority ());
+  rwlock_release_write (rw);
+  msg ("writer: done");
+}
+
+static void
+reader_thread_func (void *rw_) 
+{
+  struct rwlock *rw = rw_;
+
+  rwlock_acquire_read (rw);
+  msg ("reader: reading.");
+  rwlock_release_read (rw);
+  msg ("reader: done");
+}
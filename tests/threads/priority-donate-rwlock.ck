@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-rwlock) begin
+(priority-donate-rwlock) main: reading.
+(priority-donate-rwlock) main: writer is waiting.
+(priority-donate-rwlock) main: reader is waiting behind the writer.
+(priority-donate-rwlock) writer: writing at priority 35.
+(priority-donate-rwlock) reader: reading.
+(priority-donate-rwlock) reader: done
+(priority-donate-rwlock) writer: done
+(priority-donate-rwlock) main: writer and reader must already have finished.
+(priority-donate-rwlock) end
+EOF
+pass;
@@ -0,0 +1,76 @@
+/* Creates 256 threads spread over eight priorities, all runnable
+   at once, and has each of them yield many times.  Checks that
+   the threads finish strictly in priority order, and reports how
+   long the whole run takes, which is dominated by the cost of the
+   scheduler's ready queue operations. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 256
+#define PRIORITY_CNT 8
+#define YIELD_CNT 64
+
+static thread_func yield_thread;
+
+/* Priorities of the threads, in the order they finished. */
+static int finish_order[THREAD_CNT];
+static int finish_cnt;
+
+void
+test_priority_sched_bench (void) 
+{
+  int64_t start;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  /* Create every thread below our own priority so that none of
+     them runs until all of them are ready. */
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "yield %d", i);
+      thread_create (name, PRI_DEFAULT - 1 - i % PRIORITY_CNT,
+                     yield_thread, NULL);
+    }
+  msg ("%d threads at %d priorities yield %d times each.",
+       THREAD_CNT, PRIORITY_CNT, YIELD_CNT);
+
+  /* Let them all run to completion. */
+  start = timer_now_ns ();
+  thread_set_priority (PRI_MIN);
+  msg ("%d threads ran in %"PRId64" us.", finish_cnt,
+       (timer_now_ns () - start) / 1000);
+  thread_set_priority (PRI_DEFAULT);
+
+  if (finish_cnt != THREAD_CNT)
+    fail ("only %d of %d threads finished", finish_cnt, THREAD_CNT);
+  for (i = 1; i < THREAD_CNT; i++)
+    if (finish_order[i] > finish_order[i - 1])
+      fail ("thread at priority %d finished after one at priority %d",
+            finish_order[i], finish_order[i - 1]);
+  msg ("Threads finished in priority order.");
+}
+
+static void 
+yield_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < YIELD_CNT; i++)
+    thread_yield ();
+
+  enum intr_level old_level = intr_disable ();
+  finish_order[finish_cnt++] = thread_get_priority ();
+  intr_set_level (old_level);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/threads ran in \d+ us\.$/, 1,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(priority-sched-bench) begin
+(priority-sched-bench) 256 threads at 8 priorities yield 64 times each.
+(priority-sched-bench) Threads finished in priority order.
+(priority-sched-bench) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Reads the nanosecond clock repeatedly while spinning for 10 ms,
+   checking that it never goes backward and that it resolves
+   intervals much shorter than a timer tick. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int64_t start, prev, now;
+  long long reads = 0;
+
+  start = prev = clock_ns ();
+  CHECK (start > 0, "clock is past boot");
+  do
+    {
+      now = clock_ns ();
+      if (now < prev)
+        fail ("clock went backward from %lld to %lld ns",
+              (long long) prev, (long long) now);
+      prev = now;
+      reads++;
+    }
+  while (now - start < 10 * 1000 * 1000);
+
+  /* A clock that only advanced once per 10 ms timer tick would
+     have ended the loop after a handful of distinct readings. */
+  if (reads < 100)
+    fail ("only %lld readings in 10 ms", reads);
+  msg ("clock advanced without going backward");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(clock) begin
+(clock) clock is past boot
+(clock) clock advanced without going backward
+(clock) end
+clock: exit(0)
+EOF
+pass;
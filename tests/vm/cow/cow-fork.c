@@ -0,0 +1,50 @@
+/* Forks repeatedly from a process with a resident data segment and
+   reports how many frames each fork costs.  With copy-on-write a
+   child only pays for the pages it writes, not for every page of
+   its parent. */
+
+#include <string.h>
+#include <syscall.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/large.inc"
+
+#define PAGE_SIZE 4096
+#define CHUNK_PAGES 64
+#define FORK_CNT 16
+
+/* A child writes to its stack and to one page of LARGE, and may fault
+   in a page or two of code the parent never ran.  A fork that copied
+   the resident pages would cost at least CHUNK_PAGES frames. */
+#define FORK_FRAME_MAX 8
+
+void
+test_main (void)
+{
+	long long frame_cnt;
+	int sum = 0;
+	int i;
+
+	/* Bring the first CHUNK_PAGES pages of LARGE into memory. */
+	for (i = 0; i < CHUNK_PAGES; i++)
+		sum += large[i * PAGE_SIZE];
+
+	frame_cnt = get_frame_alloc_cnt ();
+	for (i = 0; i < FORK_CNT; i++) {
+		pid_t child = fork ("child");
+		if (child == 0) {
+			/* Dirty a single page; the rest stay shared with the parent. */
+			large[(i % CHUNK_PAGES) * PAGE_SIZE] = '@';
+			exit (i);
+		}
+		if (wait (child) != i)
+			fail ("wait for child %d", i);
+	}
+	frame_cnt = (get_frame_alloc_cnt () - frame_cnt) / FORK_CNT;
+
+	msg ("%lld frames allocated per fork", frame_cnt);
+	CHECK (frame_cnt <= FORK_FRAME_MAX, "fork shares resident pages");
+	CHECK (memcmp (large, "Lorem ipsum", 11) == 0, "check data consistency");
+}
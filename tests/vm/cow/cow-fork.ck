@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected_with_reports (qr/frames allocated per fork$/, 1,
+			     IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cow-fork) begin
+(cow-fork) fork shares resident pages
+(cow-fork) check data consistency
+(cow-fork) end
+EOF
+pass;
@@ -0,0 +1,84 @@
+/* Reads and then writes the pages of a BSS array and grows the
+   stack, checking that the vmstat system call counts the faults
+   that each step takes. */
+
+#include <string.h>
+#include <syscall.h>
+#include <vmstat.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 8
+
+static char buf[PAGE_CNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Returns how much counter C of ST grew since BEFORE. */
+static long long
+grew (const struct vmstat *st, const struct vmstat *before,
+      enum vmstat_counter c)
+{
+  return st->proc[c] - before->proc[c];
+}
+
+/* Touches a few pages of stack below the current one. */
+static void __attribute__ ((noinline))
+grow_stack (void)
+{
+  volatile char stack_buf[3 * PAGE_SIZE];
+  size_t i;
+
+  for (i = sizeof stack_buf; i > 0; i -= PAGE_SIZE)
+    stack_buf[i - 1] = 1;
+}
+
+void
+test_main (void)
+{
+  struct vmstat before, st;
+  long long zero, anon;
+  size_t i;
+  int k, b;
+  int sum = 0;
+
+  /* The first call may fault in ST itself. */
+  CHECK (vmstat (&before) && vmstat (&before), "vmstat");
+  CHECK (before.proc[VMSTAT_MAJOR_FAULTS] > 0,
+         "loading the program took major faults");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    sum += buf[i * PAGE_SIZE];
+  vmstat (&st);
+  zero = st.faults[VMSTAT_FAULT_ZERO] - before.faults[VMSTAT_FAULT_ZERO];
+  CHECK (sum == 0 && zero >= PAGE_CNT && grew (&st, &before,
+         VMSTAT_MINOR_FAULTS) >= PAGE_CNT,
+         "reading %d BSS pages took minor zero-page faults", PAGE_CNT);
+
+  before = st;
+  memset (buf, 1, sizeof buf);
+  vmstat (&st);
+  anon = st.faults[VMSTAT_FAULT_ANON] - before.faults[VMSTAT_FAULT_ANON];
+  CHECK (anon >= PAGE_CNT && grew (&st, &before,
+         VMSTAT_MINOR_FAULTS) >= PAGE_CNT,
+         "writing them took minor anonymous faults");
+
+  before = st;
+  grow_stack ();
+  vmstat (&st);
+  CHECK (grew (&st, &before, VMSTAT_STACK_GROWTHS) >= 1,
+         "growing the stack was counted");
+
+  for (k = 0; k < VMSTAT_COUNTER_CNT; k++)
+    if (st.global[k] < st.proc[k])
+      fail ("system counter %d is below the process's", k);
+  for (k = 0; k < VMSTAT_FAULT_CNT; k++)
+    {
+      long long total = 0;
+      for (b = 0; b < VMSTAT_BUCKETS; b++)
+        total += st.latency[k][b];
+      if (total != st.faults[k])
+        fail ("latency histogram %d holds %lld of %lld faults",
+              k, total, st.faults[k]);
+    }
+  msg ("system counters and histograms are consistent");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vmstat) begin
+(vmstat) vmstat
+(vmstat) loading the program took major faults
+(vmstat) reading 8 BSS pages took minor zero-page faults
+(vmstat) writing them took minor anonymous faults
+(vmstat) growing the stack was counted
+(vmstat) system counters and histograms are consistent
+(vmstat) end
+EOF
+pass;
@@ -1,6 +1,7 @@
 #include "threads/init.h"
 #include <console.h>
 #include <debug.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <random.h>
 #include <stddef.h>
@@ -16,10 +17,12 @@
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
+#include "threads/magazine.h"
 #include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -34,8 +37,10 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -51,7 +56,19 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* Boot-time breakdown: TSC cycles spent in each phase of main()
+   up to "Boot complete", printed at shutdown with -q. */
+#define BOOT_PHASE_MAX 8
+static struct boot_phase {
+	const char *name;
+	uint64_t cycles;
+} boot_phases[BOOT_PHASE_MAX];
+static int boot_phase_cnt;
+static uint64_t boot_phase_start;
+
 static void bss_init (void);
+static void boot_phase (const char *name);
+static void print_boot_stats (void);
 static void paging_init (uint64_t mem_end);
 
 static char **read_command_line (void);
@@ -72,6 +89,7 @@ main (void) {
 
 	/* Clear BSS and get machine's RAM size. */
 	bss_init ();
+	boot_phase_start = timer_cycles ();
 
 	/* Break command line into arguments and parse options. */
 	argv = read_command_line ();
@@ -81,11 +99,13 @@ main (void) {
 	   then enable console locking. */
 	thread_init ();
 	console_init ();
+	boot_phase ("command line and threads");
 
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
 	paging_init (mem_end);
+	boot_phase ("memory");
 
 #ifdef USERPROG
 	tss_init ();
@@ -104,16 +124,20 @@ main (void) {
 	/* Start thread scheduler and enable interrupts. */
 	thread_start ();
 	serial_init_queue ();
+	boot_phase ("devices and interrupts");
 	timer_calibrate ();
+	boot_phase ("timer calibration");
 
 #ifdef FILESYS
 	/* Initialize file system. */
 	disk_init ();
 	filesys_init (format_filesys);
+	boot_phase ("file system");
 #endif
 
 #ifdef VM
 	vm_init ();
+	boot_phase ("virtual memory");
 #endif
 
 	printf ("Boot complete.\n");
@@ -140,6 +164,32 @@ bss_init (void) {
 	memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Records that the boot phase NAME, begun where the previous one
+   ended, is complete. */
+static void
+boot_phase (const char *name) {
+	uint64_t now = timer_cycles ();
+
+	ASSERT (boot_phase_cnt < BOOT_PHASE_MAX);
+	boot_phases[boot_phase_cnt].name = name;
+	boot_phases[boot_phase_cnt].cycles = now - boot_phase_start;
+	boot_phase_cnt++;
+	boot_phase_start = now;
+}
+
+/* Prints how long each boot phase took. */
+static void
+print_boot_stats (void) {
+	int64_t total = 0;
+
+	for (int i = 0; i < boot_phase_cnt; i++) {
+		int64_t us = timer_cycles_to_ns (boot_phases[i].cycles) / 1000;
+		printf ("Boot: %'"PRId64" us in %s\n", us, boot_phases[i].name);
+		total += us;
+	}
+	printf ("Boot: %'"PRId64" us total\n", total);
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
  * Points base_pml4 to the pml4 it creates. */
@@ -221,11 +271,38 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-lpt")) {
+			if (value == NULL || atoi (value) <= 0)
+				PANIC ("bad loops per tick `%s' (use -h for help)", value);
+			timer_preset_loops (atoi (value));
+		}
+		else if (!strcmp (name, "-palloc")) {
+			if (value != NULL && !strcmp (value, "buddy"))
+				palloc_policy = PALLOC_BUDDY;
+			else if (value != NULL && !strcmp (value, "bitmap"))
+				palloc_policy = PALLOC_BITMAP;
+			else
+				PANIC ("unknown page allocator `%s' (use -h for help)", value);
+		}
+		else if (!strcmp (name, "-nomag"))
+			magazines_enabled = false;
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			if (value != NULL && !strcmp (value, "fifo"))
+				evict_policy = EVICT_FIFO;
+			else if (value != NULL && !strcmp (value, "clock"))
+				evict_policy = EVICT_CLOCK;
+			else
+				PANIC ("unknown eviction policy `%s' (use -h for help)", value);
+		}
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -326,8 +403,15 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -tickless          Stop the timer tick while the CPU is idle.\n"
+			"  -lpt=LOOPS         Skip timer calibration, using LOOPS loops per tick.\n"
+			"  -palloc=POLICY     Find pages by `buddy' (default) or `bitmap' scan.\n"
+			"  -nomag             Do not cache freed blocks and pages per CPU.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Evict frames by `clock' (default) or `fifo'.\n"
 #endif
 			);
 	power_off ();
@@ -352,14 +436,24 @@ power_off (void) {
 /* Print statistics about Pintos execution. */
 static void
 print_stats (void) {
+	if (power_off_when_done)
+		print_boot_stats ();
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	malloc_print_stats ();
+	slab_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
+	inode_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
 #endif
+#ifdef VM
+	vm_print_stats ();
+#endif
 }
@@ -0,0 +1,84 @@
+#include "threads/magazine.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+
+/* Magazines.
+
+   malloc() and palloc_get_page() take a lock on every call, and
+   most of the time they hand back a block that was freed a
+   moment ago.  A magazine keeps the last few freed blocks of one
+   size on a stack so that the next allocation of that size pops
+   one off without taking a lock or touching the allocator's free
+   lists.  When the stack runs dry, its owner refills MAG_BATCH
+   rounds under one acquisition of its lock; when it overflows,
+   MAG_BATCH rounds go back the same way.  Moving half a magazine
+   at a time keeps a loop that allocates and frees right at the
+   boundary from going to the lock on every call.
+
+   This is the "magazine" layer of Bonwick and Adams' Vmem paper,
+   without the depot of spare magazines, which only pays off when
+   several CPUs trade blocks.  Pintos runs on one CPU, so each
+   allocator keeps a single magazine per size, and turning
+   interrupts off is all it takes to own it. */
+
+/* Whether allocators use their magazines. */
+bool magazines_enabled = true;
+
+/* Pops the most recently pushed round off M and returns it, or
+   returns a null pointer if M is empty.  Counts a hit or a
+   miss. */
+void *
+magazine_pop (struct magazine *m) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (m->round_cnt == 0) {
+		m->miss_cnt++;
+		return NULL;
+	}
+	m->hit_cnt++;
+	return m->rounds[--m->round_cnt];
+}
+
+/* Pushes ROUND onto M and returns true, or returns false if M is
+   full. */
+bool
+magazine_push (struct magazine *m, void *round) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (round != NULL);
+
+	if (m->round_cnt >= MAG_ROUNDS)
+		return false;
+	m->rounds[m->round_cnt++] = round;
+	return true;
+}
+
+/* Removes up to CNT rounds from M, the oldest first, and stores
+   them in ROUNDS.  Returns the number removed. */
+size_t
+magazine_unload (struct magazine *m, void **rounds, size_t cnt) {
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (cnt > m->round_cnt)
+		cnt = m->round_cnt;
+	for (i = 0; i < cnt; i++)
+		rounds[i] = m->rounds[i];
+	for (i = cnt; i < m->round_cnt; i++)
+		m->rounds[i - cnt] = m->rounds[i];
+	m->round_cnt -= cnt;
+	return cnt;
+}
+
+/* Prints M's hit rate, describing M as NAME. */
+void
+magazine_print_stats (const char *name, const struct magazine *m) {
+	long long total = m->hit_cnt + m->miss_cnt;
+
+	if (total == 0)
+		return;
+	printf ("Magazine: %s: %lld allocations, %lld hits (%lld%%), "
+			"%zu rounds loaded\n", name, total, m->hit_cnt,
+			m->hit_cnt * 100 / total, m->round_cnt);
+}
@@ -5,7 +5,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
+#include "threads/magazine.h"
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -32,7 +35,18 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Each descriptor also has a magazine (see magazine.c) of blocks
+   freed a moment ago, so that most calls find a block there
+   without taking the descriptor's lock.  Blocks in a magazine
+   count as in use as far as their arena is concerned, so a
+   magazine can keep up to MAG_ROUNDS arenas of each size alive.
+
+   free() also accepts objects from the caches in slab.c, whose
+   pages start with their own magic number, so code that frees an
+   object without knowing which allocator it came from keeps
+   working. */
 
 /* Descriptor. */
 struct desc {
@@ -40,6 +54,7 @@ struct desc {
 	size_t blocks_per_arena;    /* Number of blocks in an arena. */
 	struct list free_list;      /* List of free blocks. */
 	struct lock lock;           /* Lock. */
+	struct magazine mag;        /* Recently freed blocks. */
 };
 
 /* Magic number for detecting arena corruption. */
@@ -63,6 +78,9 @@ static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get_block (struct desc *);
+static void desc_put_block (struct desc *, struct block *);
+static void desc_put_blocks (struct desc *, void **blocks, size_t cnt);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -112,34 +130,38 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
+	/* Reuse a block freed a moment ago, if there is one. */
+	if (magazines_enabled) {
+		enum intr_level old_level = intr_disable ();
+		b = magazine_pop (&d->mag);
+		intr_set_level (old_level);
+		if (b != NULL)
+			return b;
+	}
 
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	/* Otherwise take one from the free list, along with a batch to
+	   reload the magazine. */
+	void *batch[MAG_BATCH];
+	size_t batch_cnt = 0;
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
-			return NULL;
-		}
+	lock_acquire (&d->lock);
+	b = desc_get_block (d);
+	if (b != NULL && magazines_enabled)
+		while (batch_cnt < MAG_BATCH
+				&& (batch[batch_cnt] = desc_get_block (d)) != NULL)
+			batch_cnt++;
+	lock_release (&d->lock);
 
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
+	if (batch_cnt > 0) {
+		/* Another thread may have reloaded the magazine in the
+		   meantime; give back whatever does not fit. */
+		enum intr_level old_level = intr_disable ();
+		size_t i = 0;
+		while (i < batch_cnt && magazine_push (&d->mag, batch[i]))
+			i++;
+		intr_set_level (old_level);
+		desc_put_blocks (d, batch + i, batch_cnt - i);
 	}
-
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
-	lock_release (&d->lock);
 	return b;
 }
 
@@ -200,7 +222,9 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
-	if (p != NULL) {
+	if (p != NULL && slab_owns (p))
+		slab_free (NULL, p);
+	else if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
 		struct desc *d = a->desc;
@@ -213,24 +237,24 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
+			if (magazines_enabled) {
+				/* Keep it for the next malloc().  If the magazine is
+				   full, send its oldest blocks back to make room. */
+				void *batch[MAG_BATCH];
+				size_t batch_cnt = 0;
+				enum intr_level old_level = intr_disable ();
 
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
+				if (!magazine_push (&d->mag, b)) {
+					batch_cnt = magazine_unload (&d->mag, batch, MAG_BATCH);
+					magazine_push (&d->mag, b);
 				}
-				palloc_free_page (a);
+				intr_set_level (old_level);
+				desc_put_blocks (d, batch, batch_cnt);
+			} else {
+				lock_acquire (&d->lock);
+				desc_put_block (d, b);
+				lock_release (&d->lock);
 			}
-
-			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +263,96 @@ free (void *p) {
 	}
 }
 
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty, and returns it.  Returns a null pointer if no
+   page is available.  D's lock must be held. */
+static struct block *
+desc_get_block (struct desc *d) {
+	struct block *b;
+	struct arena *a;
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* If the free list is empty, create a new arena. */
+	if (list_empty (&d->free_list)) {
+		size_t i;
+
+		/* Allocate a page. */
+		a = palloc_get_page (0);
+		if (a == NULL)
+			return NULL;
+
+		/* Initialize arena and add its blocks to the free list. */
+		a->magic = ARENA_MAGIC;
+		a->desc = d;
+		a->free_cnt = d->blocks_per_arena;
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_push_back (&d->free_list, &b->free_elem);
+		}
+	}
+
+	/* Get a block from free list and return it. */
+	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+	a = block_to_arena (b);
+	a->free_cnt--;
+	return b;
+}
+
+/* Returns block B to D's free list, and its arena to the page
+   allocator if that leaves the arena unused.  D's lock must be
+   held. */
+static void
+desc_put_block (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+	ASSERT (a->desc == d);
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		palloc_free_page (a);
+	}
+}
+
+/* Returns the CNT blocks in BLOCKS to D's free list under a single
+   acquisition of D's lock. */
+static void
+desc_put_blocks (struct desc *d, void **blocks, size_t cnt) {
+	size_t i;
+
+	if (cnt == 0)
+		return;
+	lock_acquire (&d->lock);
+	for (i = 0; i < cnt; i++)
+		desc_put_block (d, blocks[i]);
+	lock_release (&d->lock);
+}
+
+/* Prints how often each descriptor's magazine satisfied
+   malloc(). */
+void
+malloc_print_stats (void) {
+	size_t i;
+
+	for (i = 0; i < desc_cnt; i++) {
+		char name[32];
+
+		snprintf (name, sizeof name, "malloc %zu", descs[i].block_size);
+		magazine_print_stats (name, &descs[i].mag);
+	}
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
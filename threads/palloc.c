@@ -8,7 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/magazine.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -24,13 +26,51 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free pages are kept by a binary buddy allocator:
+   free list K holds free blocks of 2**K pages, each aligned to
+   its size within the pool.  A request takes the smallest block
+   that fits, splitting larger ones, and gives the pages past the
+   request back at once; a free merges each block with its buddy
+   for as long as the buddy is free too.  Both are O(log n).  The
+   used_map bitmap is kept in step, and when no block is large
+   enough it is scanned first fit, as palloc always did, for a run
+   the buddy lists could not see through their alignment.
+
+   Single pages, by far the most common request, first go through
+   a magazine per pool (see magazine.c).  Pages in a magazine are
+   marked used in the bitmap; a request that finds no free run
+   flushes the pool's magazine back before giving up.
+
+   Pages are freed with interrupts off (see thread.c's
+   do_schedule()), so the pools are guarded by spin locks rather
+   than locks that may sleep. */
+
+/* Number of buddy orders: blocks of up to 2**(BUDDY_ORDERS - 1)
+   pages. */
+#define BUDDY_ORDERS 16
+
+/* A free block, stored in its own first page. */
+struct free_block {
+	struct list_elem elem;          /* Element in a free list. */
+};
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
+	struct spinlock lock;           /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t page_cnt;                /* Number of pages in pool. */
+
+	/* Buddy allocator. */
+	uint8_t *free_order;            /* Per page: 1 + order if it starts
+	                                   a free block, else 0. */
+	struct list free_lists[BUDDY_ORDERS]; /* Free blocks by order. */
+	size_t free_cnt[BUDDY_ORDERS];  /* Blocks on each free list. */
+	long long fallback_cnt;         /* Requests served by bitmap scan. */
+
+	struct magazine mag;            /* Recently freed single pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +78,17 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+enum palloc_policy palloc_policy = PALLOC_BUDDY;
+
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
+static void init_buddy (struct pool *);
 
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_alloc (struct pool *, size_t page_cnt);
+static void pool_free (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t pool_flush_magazine (struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -250,9 +297,146 @@ palloc_init (void) {
 	printf ("\text_mem: 0x%llx ~ 0x%llx (Usable: %'llu kB)\n",
 		  ext_mem.start, ext_mem.end, ext_mem.size / 1024);
 	populate_pools (&base_mem, &ext_mem);
+	init_buddy (&kernel_pool);
+	init_buddy (&user_pool);
 	return ext_mem.end;
 }
 
+/* Returns the first page of the block at page IDX of POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t idx) {
+	return (struct free_block *) (pool->base + PGSIZE * idx);
+}
+
+/* Puts the free block of 2**ORDER pages at IDX of POOL on its free
+   list, first merging it with its buddy for as long as the buddy
+   is a free block of the same order. */
+static void
+buddy_free (struct pool *pool, size_t idx, unsigned order) {
+	while (order + 1 < BUDDY_ORDERS) {
+		size_t buddy = idx ^ ((size_t) 1 << order);
+		if (buddy + ((size_t) 1 << order) > pool->page_cnt
+				|| pool->free_order[buddy] != order + 1)
+			break;
+
+		list_remove (&idx_to_block (pool, buddy)->elem);
+		pool->free_cnt[order]--;
+		pool->free_order[buddy] = 0;
+		idx &= ~((size_t) 1 << order);
+		order++;
+	}
+
+	pool->free_order[idx] = order + 1;
+	list_push_front (&pool->free_lists[order], &idx_to_block (pool, idx)->elem);
+	pool->free_cnt[order]++;
+}
+
+/* Frees the PAGE_CNT pages at IDX of POOL to the buddy lists, as
+   the largest aligned blocks that tile them. */
+static void
+buddy_free_range (struct pool *pool, size_t idx, size_t page_cnt) {
+	while (page_cnt > 0) {
+		unsigned order = 0;
+		while (order + 1 < BUDDY_ORDERS
+				&& idx % ((size_t) 1 << (order + 1)) == 0
+				&& ((size_t) 1 << (order + 1)) <= page_cnt)
+			order++;
+		buddy_free (pool, idx, order);
+		idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Takes PAGE_CNT pages from POOL's buddy lists and returns the
+   index of the first, or BITMAP_ERROR if no free block is big
+   enough. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt) {
+	struct free_block *b;
+	unsigned order = 0, k;
+	size_t idx;
+
+	while (((size_t) 1 << order) < page_cnt)
+		if (++order >= BUDDY_ORDERS)
+			return BITMAP_ERROR;
+	for (k = order; k < BUDDY_ORDERS && pool->free_cnt[k] == 0; k++)
+		continue;
+	if (k == BUDDY_ORDERS)
+		return BITMAP_ERROR;
+
+	b = list_entry (list_pop_front (&pool->free_lists[k]),
+			struct free_block, elem);
+	idx = pg_no (b) - pg_no (pool->base);
+	pool->free_cnt[k]--;
+	pool->free_order[idx] = 0;
+
+	/* Split down to ORDER; each upper half's buddy is in use. */
+	while (k > order) {
+		size_t half;
+
+		k--;
+		half = idx + ((size_t) 1 << k);
+		pool->free_order[half] = k + 1;
+		list_push_front (&pool->free_lists[k], &idx_to_block (pool, half)->elem);
+		pool->free_cnt[k]++;
+	}
+
+	/* Give back the pages past PAGE_CNT. */
+	buddy_free_range (pool, idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+	return idx;
+}
+
+/* Takes the PAGE_CNT free pages at IDX of POOL off the buddy lists,
+   splitting the free blocks they lie in and freeing what is left
+   of those blocks. */
+static void
+buddy_take_range (struct pool *pool, size_t idx, size_t page_cnt) {
+	size_t end = idx + page_cnt;
+
+	while (idx < end) {
+		unsigned order;
+		size_t head = idx, size;
+
+		/* Find the free block holding page IDX. */
+		for (order = 0; order < BUDDY_ORDERS; order++) {
+			head = idx & ~(((size_t) 1 << order) - 1);
+			if (pool->free_order[head] == order + 1)
+				break;
+		}
+		ASSERT (order < BUDDY_ORDERS);
+		size = (size_t) 1 << order;
+
+		list_remove (&idx_to_block (pool, head)->elem);
+		pool->free_cnt[order]--;
+		pool->free_order[head] = 0;
+		buddy_free_range (pool, head, idx - head);
+		if (head + size > end) {
+			buddy_free_range (pool, end, head + size - end);
+			idx = end;
+		} else
+			idx = head + size;
+	}
+}
+
+/* Builds POOL's buddy lists from the pages populate_pools() left
+   free in its bitmap. */
+static void
+init_buddy (struct pool *pool) {
+	size_t idx = 0;
+	unsigned order;
+
+	for (order = 0; order < BUDDY_ORDERS; order++)
+		list_init (&pool->free_lists[order]);
+	while ((idx = bitmap_scan (pool->used_map, idx, 1, false)) != BITMAP_ERROR) {
+		size_t end = bitmap_scan (pool->used_map, idx, 1, true);
+		if (end == BITMAP_ERROR)
+			end = pool->page_cnt;
+		buddy_free_range (pool, idx, end - idx);
+		idx = end;
+	}
+}
+
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -262,16 +446,43 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
+	size_t page_idx = BITMAP_ERROR;
+	void *pages = NULL;
+
+	if (page_cnt == 0)
+		return NULL;
+
+	if (page_cnt == 1 && magazines_enabled) {
+		/* Reuse a page freed a moment ago, if there is one. */
+		enum intr_level old_level = intr_disable ();
+		pages = magazine_pop (&pool->mag);
+		if (pages == NULL) {
+			/* Otherwise take one from the pool, along with a batch
+			   to reload the magazine.  With interrupts off, nobody
+			   else can have reloaded it meanwhile. */
+			size_t i;
+
+			spin_lock (&pool->lock);
+			page_idx = pool_alloc (pool, 1);
+			for (i = 0; page_idx != BITMAP_ERROR && i < MAG_BATCH; i++) {
+				size_t idx = pool_alloc (pool, 1);
+				if (idx == BITMAP_ERROR)
+					break;
+				magazine_push (&pool->mag, pool->base + PGSIZE * idx);
+			}
+			spin_unlock (&pool->lock);
+		}
+		intr_set_level (old_level);
+	} else {
+		spin_lock (&pool->lock);
+		page_idx = pool_alloc (pool, page_cnt);
+		if (page_idx == BITMAP_ERROR && pool_flush_magazine (pool) > 0)
+			page_idx = pool_alloc (pool, page_cnt);
+		spin_unlock (&pool->lock);
+	}
 
 	if (page_idx != BITMAP_ERROR)
 		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -318,8 +529,107 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
+	if (page_cnt == 1 && magazines_enabled) {
+		/* Keep it for the next palloc_get_page(). */
+		enum intr_level old_level = intr_disable ();
+		if (!magazine_push (&pool->mag, pages)) {
+			/* The magazine is full: send its oldest pages back to
+			   make room. */
+			void *batch[MAG_BATCH];
+			size_t batch_cnt = magazine_unload (&pool->mag, batch, MAG_BATCH);
+			size_t i;
+
+			spin_lock (&pool->lock);
+			for (i = 0; i < batch_cnt; i++)
+				pool_free (pool, pg_no (batch[i]) - pg_no (pool->base), 1);
+			spin_unlock (&pool->lock);
+			magazine_push (&pool->mag, pages);
+		}
+		intr_set_level (old_level);
+	} else {
+		spin_lock (&pool->lock);
+		pool_free (pool, page_idx, page_cnt);
+		spin_unlock (&pool->lock);
+	}
+}
+
+/* Takes PAGE_CNT contiguous free pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no such run.
+   POOL's lock must be held. */
+static size_t
+pool_alloc (struct pool *pool, size_t page_cnt) {
+	size_t page_idx = BITMAP_ERROR;
+
+	ASSERT (spin_lock_held (&pool->lock));
+
+	if (palloc_policy == PALLOC_BUDDY)
+		page_idx = buddy_alloc (pool, page_cnt);
+	if (page_idx == BITMAP_ERROR) {
+		page_idx = bitmap_scan (pool->used_map, 0, page_cnt, false);
+		if (page_idx != BITMAP_ERROR && palloc_policy == PALLOC_BUDDY) {
+			buddy_take_range (pool, page_idx, page_cnt);
+			pool->fallback_cnt++;
+		}
+	}
+	if (page_idx != BITMAP_ERROR) {
+		ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+		bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+	}
+	return page_idx;
+}
+
+/* Returns the PAGE_CNT pages starting at index PAGE_IDX to POOL.
+   POOL's lock must be held. */
+static void
+pool_free (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	ASSERT (spin_lock_held (&pool->lock));
 	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+
 	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	if (palloc_policy == PALLOC_BUDDY)
+		buddy_free_range (pool, page_idx, page_cnt);
+}
+
+/* Returns every page in POOL's magazine to POOL, so that they can
+   merge into larger runs.  Returns the number of pages returned.
+   POOL's lock must be held. */
+static size_t
+pool_flush_magazine (struct pool *pool) {
+	void *batch[MAG_ROUNDS];
+	size_t batch_cnt = magazine_unload (&pool->mag, batch, MAG_ROUNDS);
+	size_t i;
+
+	for (i = 0; i < batch_cnt; i++)
+		pool_free (pool, pg_no (batch[i]) - pg_no (pool->base), 1);
+	return batch_cnt;
+}
+
+/* Prints page allocator statistics: each pool's free pages, how
+   many free blocks of each order make them up, and how often its
+   magazine had a page. */
+void
+palloc_print_stats (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+	const char *names[] = { "kernel", "user" };
+	size_t i;
+
+	for (i = 0; i < 2; i++) {
+		struct pool *pool = pools[i];
+		size_t free = bitmap_count (pool->used_map, 0, pool->page_cnt, false);
+		unsigned order;
+
+		printf ("Palloc: %s pool: %zu of %zu pages free (%zu cached)",
+				names[i], free, pool->page_cnt, pool->mag.round_cnt);
+		if (palloc_policy == PALLOC_BUDDY) {
+			printf (", blocks by order:");
+			for (order = 0; order < BUDDY_ORDERS; order++)
+				printf (" %zu", pool->free_cnt[order]);
+			printf (", %lld bitmap fallbacks", pool->fallback_cnt);
+		}
+		printf ("\n");
+	}
+	magazine_print_stats ("palloc kernel", &kernel_pool.mag);
+	magazine_print_stats ("palloc user", &user_pool.mag);
 }
 
 /* Frees the page at PAGE. */
@@ -331,15 +641,20 @@ palloc_free_page (void *page) {
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
+  /* We'll put the pool's used_map at its base, followed by the
+     buddy allocator's per-page orders.
+     Calculate the space needed for both
      and subtract it from the pool's size. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t bm_size = bitmap_buf_size (pgcnt);
+	size_t bm_pages = DIV_ROUND_UP (bm_size + pgcnt, PGSIZE) * PGSIZE;
 
-	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
+	spin_lock_init(&p->lock);
+	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_size);
 	p->base = (void *) start;
+	p->page_cnt = pgcnt;
+	p->free_order = (uint8_t *) *bm_base + bm_size;
+	memset (p->free_order, 0, pgcnt);
 
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
@@ -353,6 +668,6 @@ static bool
 page_from_pool (const struct pool *pool, void *page) {
 	size_t page_no = pg_no (page);
 	size_t start_page = pg_no (pool->base);
-	size_t end_page = start_page + bitmap_size (pool->used_map);
+	size_t end_page = start_page + pool->page_cnt;
 	return page_no >= start_page && page_no < end_page;
 }
@@ -0,0 +1,273 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds each request up to a power of 2, so a structure
+   just past a power of 2 wastes nearly half its block.  A cache
+   instead hands out objects of one exact size, carved out of
+   page-sized "slabs".  Each slab starts with a header and chains
+   its free objects through their first word.
+
+   A cache keeps its slabs on three lists: partial slabs, from
+   which objects are allocated first, full slabs, which are left
+   alone until an object is freed, and empty slabs.  At most one
+   empty slab is kept, so that an object freed and allocated
+   again in a loop does not bounce a page through the page
+   allocator; the others go back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Number of caches that may be created. */
+#define CACHE_CNT 8
+
+/* Object cache. */
+struct slab_cache {
+	const char *name;           /* For statistics. */
+	size_t obj_size;            /* Size of each object, rounded up. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	slab_ctor_func *ctor;       /* Constructor, or null. */
+	struct list partial;        /* Slabs with used and free objects. */
+	struct list full;           /* Slabs with no free object. */
+	struct list empty;          /* Slabs with no used object. */
+	struct lock lock;           /* Lock. */
+
+	/* Statistics. */
+	size_t size;                /* Size requested at creation. */
+	long long alloc_cnt;        /* Objects allocated. */
+	size_t used_cnt;            /* Objects in use. */
+	size_t slab_cnt;            /* Slabs in use. */
+	size_t peak_used_cnt;       /* Most objects ever in use... */
+	size_t peak_slab_cnt;       /* ...and the slabs holding them. */
+};
+
+/* Slab header, at the start of each slab's page.
+   The magic number is the first member, like the arena header in
+   malloc.c, so free() can tell the two apart. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct slab_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of the cache's lists. */
+	size_t used_cnt;            /* Objects in use. */
+	void *free;                 /* First free object, or null. */
+};
+
+static struct slab_cache caches[CACHE_CNT];
+static size_t cache_cnt;
+
+static struct slab *slab_create (struct slab_cache *);
+static struct slab *obj_to_slab (const void *);
+
+/* Creates and returns a cache of SIZE-byte objects, described as
+   NAME in statistics.  If CTOR is non-null, slab_alloc() calls it
+   on every object it returns.  Panics if too many caches are
+   created or SIZE does not fit in a slab. */
+struct slab_cache *
+slab_cache_create (const char *name, size_t size, slab_ctor_func *ctor) {
+	struct slab_cache *c;
+
+	ASSERT (name != NULL);
+	ASSERT (size > 0);
+
+	if (cache_cnt >= CACHE_CNT)
+		PANIC ("too many slab caches creating \"%s\"", name);
+	c = &caches[cache_cnt++];
+	c->name = name;
+	c->size = size;
+	c->obj_size = ROUND_UP (size < sizeof (void *) ? sizeof (void *) : size,
+			sizeof (void *));
+	c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->obj_size;
+	if (c->objs_per_slab == 0)
+		PANIC ("slab cache \"%s\": %zu-byte objects do not fit a slab",
+				name, size);
+	c->ctor = ctor;
+	list_init (&c->partial);
+	list_init (&c->full);
+	list_init (&c->empty);
+	lock_init (&c->lock);
+	return c;
+}
+
+/* Obtains and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c) {
+	struct slab *s;
+	void *obj;
+
+	ASSERT (c != NULL);
+
+	lock_acquire (&c->lock);
+
+	/* Prefer a partial slab, then the spare empty one. */
+	if (!list_empty (&c->partial))
+		s = list_entry (list_front (&c->partial), struct slab, elem);
+	else if (!list_empty (&c->empty)) {
+		s = list_entry (list_pop_front (&c->empty), struct slab, elem);
+		list_push_front (&c->partial, &s->elem);
+		c->slab_cnt++;
+	} else {
+		s = slab_create (c);
+		if (s == NULL) {
+			lock_release (&c->lock);
+			return NULL;
+		}
+		list_push_front (&c->partial, &s->elem);
+		c->slab_cnt++;
+	}
+
+	/* Take its first free object. */
+	obj = s->free;
+	s->free = *(void **) obj;
+	if (++s->used_cnt == c->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_back (&c->full, &s->elem);
+	}
+
+	c->alloc_cnt++;
+	if (++c->used_cnt > c->peak_used_cnt) {
+		c->peak_used_cnt = c->used_cnt;
+		c->peak_slab_cnt = c->slab_cnt;
+	}
+	lock_release (&c->lock);
+
+	if (c->ctor != NULL)
+		c->ctor (obj);
+	return obj;
+}
+
+/* Returns OBJ, which must have been allocated from cache C, to C.
+   C may be null, in which case it is looked up from OBJ's slab. */
+void
+slab_free (struct slab_cache *c, void *obj) {
+	struct slab *s;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (obj);
+	if (c == NULL)
+		c = s->cache;
+	ASSERT (s->cache == c);
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs. */
+	memset (obj, 0xcc, c->obj_size);
+#endif
+
+	lock_acquire (&c->lock);
+
+	*(void **) obj = s->free;
+	s->free = obj;
+	if (s->used_cnt-- == c->objs_per_slab) {
+		/* It was full. */
+		list_remove (&s->elem);
+		list_push_front (&c->partial, &s->elem);
+	}
+	if (s->used_cnt == 0) {
+		/* It is empty: keep one spare, free the rest. */
+		list_remove (&s->elem);
+		c->slab_cnt--;
+		if (list_empty (&c->empty))
+			list_push_back (&c->empty, &s->elem);
+		else {
+			s->magic = 0;
+			palloc_free_page (s);
+		}
+	}
+	c->used_cnt--;
+
+	lock_release (&c->lock);
+}
+
+/* Returns true if OBJ was allocated from some cache.  OBJ must
+   come from a cache or from malloc(). */
+bool
+slab_owns (const void *obj) {
+	const struct slab *s = pg_round_down (obj);
+	return s->magic == SLAB_MAGIC;
+}
+
+/* Returns the number of bytes malloc() would take from the page
+   allocator for N objects of cache C. */
+static size_t
+malloc_footprint (const struct slab_cache *c, size_t n) {
+	/* malloc's arena header is three words. */
+	size_t arena_size = 3 * sizeof (void *);
+	size_t block_size = 16;
+	size_t per_page;
+
+	while (block_size < c->size)
+		block_size *= 2;
+	if (block_size >= PGSIZE / 2)
+		return n * ROUND_UP (c->size + arena_size, PGSIZE);
+
+	per_page = (PGSIZE - arena_size) / block_size;
+	return DIV_ROUND_UP (n, per_page) * PGSIZE;
+}
+
+/* Prints, for each cache, its use at its peak and how many bytes
+   of the pages it held were not objects, next to the same for
+   malloc() holding the same objects. */
+void
+slab_print_stats (void) {
+	size_t i;
+
+	for (i = 0; i < cache_cnt; i++) {
+		struct slab_cache *c = &caches[i];
+		size_t used = c->peak_used_cnt * c->size;
+
+		printf ("Slab: %s: %zu-byte objects, %lld allocated, "
+				"peak %zu in %zu slabs, %zu bytes wasted (malloc: %zu)\n",
+				c->name, c->size, c->alloc_cnt, c->peak_used_cnt,
+				c->peak_slab_cnt, c->peak_slab_cnt * PGSIZE - used,
+				malloc_footprint (c, c->peak_used_cnt) - used);
+	}
+}
+
+/* Allocates a slab for cache C and threads all of its objects onto
+   its free chain.  Returns a null pointer if no page is available. */
+static struct slab *
+slab_create (struct slab_cache *c) {
+	struct slab *s = palloc_get_page (0);
+	uint8_t *objs;
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = c;
+	s->used_cnt = 0;
+	s->free = NULL;
+	objs = (uint8_t *) (s + 1);
+	for (i = c->objs_per_slab; i-- > 0; ) {
+		void *obj = objs + i * c->obj_size;
+		*(void **) obj = s->free;
+		s->free = obj;
+	}
+	return s;
+}
+
+/* Returns the slab that OBJ is inside. */
+static struct slab *
+obj_to_slab (const void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid. */
+	ASSERT (s->magic == SLAB_MAGIC);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT ((pg_ofs (obj) - sizeof *s) % s->cache->obj_size == 0);
+
+	return s;
+}
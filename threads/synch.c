@@ -48,11 +48,69 @@ bool sem_prior_cmp(const struct list_elem *a, const struct list_elem *b, void *a
 {
 	struct semaphore_elem *waitA = list_entry(a, struct semaphore_elem, elem);
 	struct semaphore_elem *waitB = list_entry(b, struct semaphore_elem, elem);
-	struct thread *thA = list_entry(list_front(&waitA->semaphore.waiters), struct thread, elem);
-	struct thread *thB = list_entry(list_front(&waitB->semaphore.waiters), struct thread, elem);
+	struct thread *thA = heap_entry(heap_top(&waitA->semaphore.waiters), struct thread, w_elem);
+	struct thread *thB = heap_entry(heap_top(&waitB->semaphore.waiters), struct thread, w_elem);
 	return thA->priority > thB->priority;
 };
 
+// 1-2 Semaphore waiters are kept in a heap ordered by priority, and
+// by arrival among equal priorities, so sema_up() takes the top
+// waiter in O(log n) instead of sorting the whole wait list.
+static int64_t next_wait_seq;
+
+// heap order of semaphore waiters: higher priority first, then FIFO
+static bool waiter_less(const struct heap_elem *a, const struct heap_elem *b, void *aux UNUSED)
+{
+	struct thread *thA = heap_entry(a, struct thread, w_elem);
+	struct thread *thB = heap_entry(b, struct thread, w_elem);
+	if (thA->priority != thB->priority)
+		return thA->priority < thB->priority;
+	return thA->wait_seq > thB->wait_seq;
+}
+
+// Re-files LOCK in its holder's 'donor_locks' under the priority of
+// its current top waiter and recomputes the holder's donation,
+// which passes on down the chain of locks - O(log n) per holder
+static void lock_update_donation(struct lock *lock)
+{
+	struct thread *holder = lock->holder;
+	struct heap *waiters = &lock->semaphore.waiters;
+
+	if (thread_mlfqs || holder == NULL)
+		return;
+
+	if (lock->max_prior >= 0)
+		heap_remove(&holder->donor_locks, &lock->elem);
+	lock->max_prior = -1;
+	if (!heap_empty(waiters))
+	{
+		lock->max_prior = heap_entry(heap_top(waiters), struct thread, w_elem)->priority;
+		heap_push(&holder->donor_locks, &lock->elem);
+	}
+	donateMultiple(holder);
+}
+
+// the top of SEMA's waiters may have changed; if T waits on SEMA as
+// part of a lock, pass that on to the lock's holder
+static void sema_donate(struct semaphore *sema, struct thread *t)
+{
+	struct lock *lock = t->waiting_lock;
+
+	if (lock != NULL && &lock->semaphore == sema)
+		lock_update_donation(lock);
+}
+
+// Called by thread_change_priority() when T's priority changes while
+// it waits on SEMA: moves T within the waiter heap - O(log n)
+void sema_reprioritize(struct semaphore *sema, struct thread *t)
+{
+	ASSERT(intr_get_level() == INTR_OFF);
+	ASSERT(t->waiting_sema == sema);
+
+	heap_update(&sema->waiters, &t->w_elem);
+	sema_donate(sema, t);
+}
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -67,7 +125,7 @@ void sema_init(struct semaphore *sema, unsigned value)
 	ASSERT(sema != NULL);
 
 	sema->value = value;
-	list_init(&sema->waiters);
+	heap_init(&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -89,7 +147,11 @@ void sema_down(struct semaphore *sema)
 	old_level = intr_disable();
 	while (sema->value == 0)
 	{
-		list_insert_ordered(&sema->waiters, &thread_current()->elem, prior_cmp, NULL); // 1-2
+		struct thread *curr = thread_current();
+		curr->wait_seq = next_wait_seq++;
+		curr->waiting_sema = sema;
+		heap_push(&sema->waiters, &curr->w_elem); // 1-2
+		sema_donate(sema, curr);				  // 1-3
 		thread_block();
 	}
 	sema->value--;
@@ -134,11 +196,10 @@ void sema_up(struct semaphore *sema)
 	old_level = intr_disable();
 
 	struct thread *th = NULL;
-	if (!list_empty(&sema->waiters))
+	if (!heap_empty(&sema->waiters))
 	{
-		list_sort(&sema->waiters, prior_cmp, NULL); // 1-2
-		th = list_entry(list_pop_front(&sema->waiters),
-						struct thread, elem);
+		th = heap_entry(heap_pop(&sema->waiters), struct thread, w_elem); // 1-2
+		th->waiting_sema = NULL;
 		thread_unblock(th);
 	}
 
@@ -207,6 +268,7 @@ void lock_init(struct lock *lock)
 	ASSERT(lock != NULL);
 
 	lock->holder = NULL;
+	lock->max_prior = -1;
 	sema_init(&lock->semaphore, 1);
 }
 
@@ -226,30 +288,19 @@ void lock_acquire(struct lock *lock)
 
 	struct thread *curr = thread_current();
 
-	// 1-4 Forbid donation
-	if (!thread_mlfqs)
-	{
-		// 1-3
-		enum intr_level old_level = intr_disable();
-
-		// Failed to acquire lock
-		if (lock->semaphore.value == 0)
-		{
-			curr->waiting_lock = lock; // I'm waiting on this lock
-
-			// Add curr to donors list and call donateNested
-			struct thread *donee = lock->holder;
-			list_push_back(&donee->donors, &curr->d_elem);
-			donateNested(curr, curr->priority);
-		}
-
-		intr_set_level(old_level);
-	}
+	// 1-3 While curr waits in the semaphore, it donates to the holder
+	// through the lock's place in the holder's 'donor_locks'
+	enum intr_level old_level = intr_disable();
 
+	curr->waiting_lock = lock; // I'm waiting on this lock
 	sema_down(&lock->semaphore);
+	curr->waiting_lock = NULL;
+
+	// Waiters left behind now donate to the new holder
 	lock->holder = curr;
+	lock_update_donation(lock);
 
-	curr->waiting_lock = NULL; // 1-3
+	intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -265,9 +316,14 @@ bool lock_try_acquire(struct lock *lock)
 	ASSERT(lock != NULL);
 	ASSERT(!lock_held_by_current_thread(lock));
 
+	enum intr_level old_level = intr_disable();
 	success = sema_try_down(&lock->semaphore);
 	if (success)
+	{
 		lock->holder = thread_current();
+		lock_update_donation(lock);
+	}
+	intr_set_level(old_level);
 	return success;
 }
 
@@ -283,37 +339,20 @@ void lock_release(struct lock *lock)
 	ASSERT(lock_held_by_current_thread(lock));
 
 	struct thread *curr = thread_current();
+	enum intr_level old_level = intr_disable();
 
-	// 1-4 Forbid donation
-	if (!thread_mlfqs)
+	// 1-3 Waiters on 'lock' stop donating to curr - O(log n)
+	if (lock->max_prior >= 0)
 	{
-		// 1-3
-		// Check donors lsit and remove any threads waiting for the 'lock'
-		struct list *donor_list = &curr->donors;
-		for (struct list_elem *de = list_begin(donor_list);
-			 de != list_end(donor_list);)
-		{
-			struct thread *donor = list_entry(de, struct thread, d_elem);
-
-			// lock is released, so donors waiting on the same lock are released too
-			if (donor->waiting_lock == lock)
-			{
-				donor->waiting_lock = NULL;
-				de = list_remove(de);
-			}
-			else
-				de = list_next(de);
-		}
-
-		if (list_empty(donor_list))
-			curr->donatedPrior = -1;
-
-		// Recalculate donation from remaining donors
+		heap_remove(&curr->donor_locks, &lock->elem);
+		lock->max_prior = -1;
 		donateMultiple(curr);
 	}
 
 	lock->holder = NULL;
 	sema_up(&lock->semaphore);
+
+	intr_set_level(old_level);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -388,12 +427,13 @@ void cond_signal(struct condition *cond, struct lock *lock UNUSED)
 	ASSERT(!intr_context());
 	ASSERT(lock_held_by_current_thread(lock));
 
-	list_sort(&cond->waiters, sem_prior_cmp, NULL); // 1-2 cond_wait push_backs sem_elements
-
+	// 1-2 cond_wait push_backs sem_elements; take the first highest-priority one
 	if (!list_empty(&cond->waiters))
-		sema_up(&list_entry(list_pop_front(&cond->waiters),
-							struct semaphore_elem, elem)
-					 ->semaphore);
+	{
+		struct list_elem *e = list_min(&cond->waiters, sem_prior_cmp, NULL);
+		list_remove(e);
+		sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
+	}
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -410,3 +450,147 @@ void cond_broadcast(struct condition *cond, struct lock *lock)
 	while (!list_empty(&cond->waiters))
 		cond_signal(cond, lock);
 }
+
+/* Initializes reader-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.
+
+   The writer holds RW's gate lock for as long as it writes, and
+   a reader holds it only long enough to count itself in, so
+   every thread waiting for RW, reader or writer, is queued on an
+   ordinary lock.  Waiters are therefore admitted by priority and
+   donate their priority to the writer, and a writer that is
+   waiting for readers to drain already holds the gate, which
+   keeps new readers out (writer preference).  Readers already
+   inside are not boosted by a waiting writer; they hold RW only
+   for the length of one read.
+
+   RW is not recursive: a thread that holds it must not acquire
+   it again in either mode. */
+void rwlock_init(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	lock_init(&rw->gate);
+	sema_init(&rw->drained, 0);
+	rw->readers = 0;
+	rw->writer_waiting = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   waits for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->gate);
+	enum intr_level old_level = intr_disable();
+	rw->readers++;
+	intr_set_level(old_level);
+	lock_release(&rw->gate);
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader out lets a waiting writer in. */
+void rwlock_release_read(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+
+	enum intr_level old_level = intr_disable();
+	ASSERT(rw->readers > 0);
+	if (--rw->readers == 0 && rw->writer_waiting)
+	{
+		rw->writer_waiting = false;
+		sema_up(&rw->drained);
+	}
+	intr_set_level(old_level);
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+   it and every reader inside has left.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(!intr_context());
+
+	lock_acquire(&rw->gate);
+	enum intr_level old_level = intr_disable();
+	while (rw->readers > 0)
+	{
+		rw->writer_waiting = true;
+		sema_down(&rw->drained);
+	}
+	intr_set_level(old_level);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void rwlock_release_write(struct rwlock *rw)
+{
+	ASSERT(rw != NULL);
+	ASSERT(lock_held_by_current_thread(&rw->gate));
+
+	lock_release(&rw->gate);
+}
+
+/* Initializes spin lock LOCK as released.
+
+   A spin lock protects a short critical section that another CPU
+   may try to enter at the same time.  Acquiring it disables
+   interrupts on the local CPU, so the holder can neither be
+   preempted nor interrupted, and then busy-waits until the lock
+   word is free.  It never sleeps, so it may be used within an
+   interrupt handler, but it must not be held across a call that
+   can block or switch threads.
+
+   Only one CPU runs for now (see struct cpu in thread.c), so the
+   lock word is always free when spin_lock() looks at it, and taking
+   a spin lock amounts to disabling interrupts. */
+void spin_lock_init(struct spinlock *lock)
+{
+	ASSERT(lock != NULL);
+
+	lock->locked = 0;
+	lock->old_level = INTR_OFF;
+}
+
+/* Acquires spin lock LOCK, spinning until it is available. */
+void spin_lock(struct spinlock *lock)
+{
+	enum intr_level old_level;
+
+	ASSERT(lock != NULL);
+
+	old_level = intr_disable();
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+		while (lock->locked)
+			asm volatile("pause");
+	lock->old_level = old_level;
+}
+
+/* Releases spin lock LOCK and restores the interrupt level that
+   was in effect when it was acquired. */
+void spin_unlock(struct spinlock *lock)
+{
+	enum intr_level old_level;
+
+	ASSERT(spin_lock_held(lock));
+
+	old_level = lock->old_level;
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+	intr_set_level(old_level);
+}
+
+/* Returns true if LOCK is held.  Only meaningful in assertions,
+   since a spin lock does not record which CPU holds it. */
+bool spin_lock_held(const struct spinlock *lock)
+{
+	ASSERT(lock != NULL);
+
+	return lock->locked != 0;
+}
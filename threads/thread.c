@@ -11,6 +11,7 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "intrinsic.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,19 +25,78 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Per-CPU scheduler state.  Each CPU schedules from its own
+   ready queues and falls back to its own idle thread; the queues
+   are protected by a spin lock rather than by interrupt
+   disabling alone, since another CPU may wake a thread onto them.
+
+   The kernel is nonetheless uniprocessor: only the bootstrap
+   processor is started, so cpu_cnt is 1 and cpu_current() is always
+   CPU 0.  Running on more CPUs takes more than this file:
+   - starting the application processors through the local APIC;
+   - a TSS and GDT entries per CPU (userprog/tss.c, userprog/gdt.c),
+     and a way for the system call entry to find its CPU's kernel
+     stack;
+   - a timer per CPU, since the PIT interrupts CPU 0 only;
+   - cross-CPU locking for everything that still relies on disabling
+     interrupts, which includes synch.c itself, palloc, malloc, the
+     timer and the file system.
+   None of these exist yet. */
+struct cpu
+{
+	int id;					 /* Index in cpus[]. */
+	struct spinlock rq_lock; /* Protects the fields below. */
+
+	/* Processes in THREAD_READY state, that is, processes that are
+	   ready to run but not actually running: one FIFO queue per
+	   priority, and a bitmap with bit P set while ready_queues[P] is
+	   non-empty, so the highest-priority ready thread is found with a
+	   single bit scan. */
+	struct list ready_queues[PRI_MAX + 1];
+	uint64_t ready_bitmap;
+	size_t ready_cnt; /* Threads in all of ready_queues. */
+
+	struct thread *idle_thread; /* Runs when ready_queues are empty. */
+
+	/* Statistics, for judging whether balancing work between CPUs
+	   would pay: how long the ready queues get, and how often the
+	   CPU finds them empty, which is when it would try to steal. */
+	size_t ready_peak;	 /* Most threads ever in ready_queues. */
+	long long ready_sum; /* ready_cnt summed over ticks. */
+	int64_t ticks;		 /* Timer ticks seen by this CPU. */
+	long long dry_cnt;	 /* Switches that found ready_queues empty. */
+};
+
+#define NCPU_MAX 8 /* Most CPUs the scheduler can manage. */
+static struct cpu cpus[NCPU_MAX];
+static int cpu_cnt; /* Number of CPUs running. */
+
+/* List of all processes.  Processes are added to this list
+   when they are first scheduled and removed when they exit. */
+static struct list all_list;
 
 /* Project 1 */
-static struct list sleep_list; // 1-1 Alarm clock
+// 1-1 Alarm clock
+// Sleeping threads live in a hierarchical timing wheel. Level L has
+// WHEEL_SLOTS slots of 64^L ticks each; a thread is filed in the level
+// whose range covers its remaining sleep time, and the slots of level
+// L > 0 are re-filed one level down when the wheel reaches them.
+// Sleeping is O(1) and each tick only touches the threads that are due
+// plus at most one slot per level.
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+static struct list sleep_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static int64_t wheel_now; // last tick the wheel was advanced to
+
+// 1-4 MLFQS
+// Threads whose recent_cpu changed since their priority was last computed
+static struct list mlfqs_dirty_list;
+static long long mlfqs_updates; // # of priorities recomputed
 
 // #define DEBUG
 #include "my_debugHelper.c"
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -65,6 +125,7 @@ static void kernel_thread(thread_func *, void *aux);
 static void idle(void *aux UNUSED);
 static struct thread *next_thread_to_run(void);
 static void init_thread(struct thread *, const char *name, int priority);
+static bool donor_lock_less(const struct heap_elem *, const struct heap_elem *, void *aux);
 static void do_schedule(int status);
 static void schedule(void);
 static tid_t allocate_tid(void);
@@ -72,6 +133,68 @@ static tid_t allocate_tid(void);
 /* Returns true if T appears to point to a valid thread. */
 #define is_thread(t) ((t) != NULL && (t)->magic == THREAD_MAGIC)
 
+/* Returns the CPU the caller is running on.  Only the bootstrap
+   processor runs, so this is always CPU 0. */
+static struct cpu *
+cpu_current(void)
+{
+	return &cpus[0];
+}
+
+/* Returns true if T is the idle thread of its CPU. */
+static bool
+is_idle(const struct thread *t)
+{
+	return t->cpu != NULL && t == t->cpu->idle_thread;
+}
+
+/* Adds T to the back of its CPU's ready queue for its priority. */
+static void
+ready_push(struct thread *t)
+{
+	struct cpu *c = t->cpu;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	spin_lock(&c->rq_lock);
+	list_push_back(&c->ready_queues[t->priority], &t->elem);
+	c->ready_bitmap |= 1ULL << t->priority;
+	if (++c->ready_cnt > c->ready_peak)
+		c->ready_peak = c->ready_cnt;
+	spin_unlock(&c->rq_lock);
+}
+
+/* Removes T from ready queue of C.  C's rq_lock must be held. */
+static void
+queue_remove(struct cpu *c, struct thread *t)
+{
+	ASSERT(spin_lock_held(&c->rq_lock));
+	list_remove(&t->elem);
+	if (list_empty(&c->ready_queues[t->priority]))
+		c->ready_bitmap &= ~(1ULL << t->priority);
+	c->ready_cnt--;
+}
+
+/* Removes ready thread T from its ready queue. */
+static void
+ready_remove(struct thread *t)
+{
+	struct cpu *c = t->cpu;
+
+	ASSERT(intr_get_level() == INTR_OFF);
+	spin_lock(&c->rq_lock);
+	queue_remove(c, t);
+	spin_unlock(&c->rq_lock);
+}
+
+/* Returns the highest priority of any thread ready on C, or -1 if
+   no thread is ready. */
+static int
+ready_max_priority(const struct cpu *c)
+{
+	uint64_t bitmap = c->ready_bitmap;
+	return bitmap != 0 ? 63 - __builtin_clzll(bitmap) : -1;
+}
+
 /* Returns the running thread.
  * Read the CPU's stack pointer `rsp', and then round that
  * down to the start of a page.  Since `struct thread' is
@@ -111,9 +234,21 @@ void thread_init(void)
 
 	/* Init the globla thread context */
 	lock_init(&tid_lock);
-	list_init(&sleep_list);
-	list_init(&ready_list);
+	for (int level = 0; level < WHEEL_LEVELS; level++)
+		for (int slot = 0; slot < WHEEL_SLOTS; slot++)
+			list_init(&sleep_wheel[level][slot]);
+	cpu_cnt = 1;
+	for (int id = 0; id < cpu_cnt; id++)
+	{
+		struct cpu *c = &cpus[id];
+		c->id = id;
+		spin_lock_init(&c->rq_lock);
+		for (int i = PRI_MIN; i <= PRI_MAX; i++)
+			list_init(&c->ready_queues[i]);
+	}
 	list_init(&destruction_req);
+	list_init(&all_list);
+	list_init(&mlfqs_dirty_list);
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread();
@@ -152,9 +287,12 @@ void thread_start(void)
 void thread_tick(void)
 {
 	struct thread *t = thread_current();
+	struct cpu *c = cpu_current();
 
 	/* Update statistics. */
-	if (t == idle_thread)
+	c->ticks++;
+	c->ready_sum += c->ready_cnt;
+	if (is_idle(t))
 		idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
@@ -173,6 +311,17 @@ void thread_print_stats(void)
 {
 	printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 		   idle_ticks, kernel_ticks, user_ticks);
+	for (int id = 0; id < cpu_cnt; id++)
+	{
+		struct cpu *c = &cpus[id];
+		long long avg = c->ticks > 0 ? c->ready_sum * 100 / c->ticks : 0;
+
+		printf("Thread: cpu %d: %zu ready at most, %lld.%02lld on average, "
+			   "ran dry %lld times\n",
+			   id, c->ready_peak, avg / 100, avg % 100, c->dry_cnt);
+	}
+	if (thread_mlfqs)
+		printf("Thread: %lld mlfqs priority updates\n", mlfqs_updates);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -282,7 +431,7 @@ void thread_unblock(struct thread *t)
 
 	old_level = intr_disable();
 	ASSERT(t->status == THREAD_BLOCKED);
-	list_insert_ordered(&ready_list, &t->elem, prior_cmp, NULL); // 1-2
+	ready_push(t); // 1-2
 	t->status = THREAD_READY;
 	intr_set_level(old_level);
 }
@@ -332,6 +481,10 @@ void thread_exit(void)
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
 	intr_disable();
+	struct thread *curr = thread_current();
+	list_remove(&curr->all_elem);
+	if (curr->mlfqs_dirty)
+		list_remove(&curr->mlfqs_elem);
 	do_schedule(THREAD_DYING);
 	NOT_REACHED();
 }
@@ -344,8 +497,11 @@ void thread_yield(void)
 	struct thread *curr = thread_current();
 
 	enum intr_level old_level = intr_disable();
-	if (curr != idle_thread)
-		list_insert_ordered(&ready_list, &curr->elem, prior_cmp, NULL); // 1-2
+	if (!is_idle(curr))
+		ready_push(curr); // 1-2
+	else
+		timer_idle_exit(); // preempted by a woken thread while halted
+
 	do_schedule(THREAD_READY);
 	intr_set_level(old_level);
 }
@@ -365,14 +521,8 @@ void thread_set_priority(int new_priority)
 
 	intr_set_level(old_level);
 
-	if (list_size(&ready_list))
-	{
-		struct thread *cand = list_entry(list_front(&ready_list), struct thread, elem);
-		if (new_priority < cand->priority)
-		{
-			thread_yield();
-		}
-	}
+	if (new_priority < ready_max_priority(cpu_current()))
+		thread_yield();
 }
 
 /* Returns the current thread's priority. */
@@ -388,13 +538,12 @@ int f = 1 << 14;
 /* Sets the current thread's nice value to NICE. */
 void thread_set_nice(int nice UNUSED)
 {
+	enum intr_level old_level = intr_disable();
 	thread_current()->nice = nice;
 	thread_update_priority(thread_current()); // re-calculate priority with new nice
-	struct thread *cand = list_entry(list_head(&ready_list), struct thread, elem);
-	if (thread_get_priority() < cand->priority)
-	{
+	intr_set_level(old_level);
+	if (thread_get_priority() < ready_max_priority(cpu_current()))
 		thread_yield();
-	}
 }
 
 /* Returns the current thread's nice value. */
@@ -431,15 +580,21 @@ idle(void *idle_started_ UNUSED)
 {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current();
+	cpu_current()->idle_thread = thread_current();
 	sema_up(idle_started);
 
 	for (;;)
 	{
-		/* Let someone else run. */
+		/* Let someone else run, first restarting the periodic tick
+		   if an interrupt other than the timer's woke us. */
 		intr_disable();
+		timer_idle_exit();
 		thread_block();
 
+		/* Nothing else is ready: stop the periodic tick until there
+		   is work to do. */
+		timer_idle_enter();
+
 		/* Re-enable interrupts and wait for the next one.
 
 		   The `sti' instruction disables interrupts until the
@@ -485,12 +640,14 @@ init_thread(struct thread *t, const char *name, int priority)
 	t->tf.rsp = (uint64_t)t + PGSIZE - sizeof(void *);
 	t->priority = priority;
 	t->magic = THREAD_MAGIC;
+	t->cpu = cpu_current();
 
 	// 1-3 Priority donation
 	t->basePrior = priority;
 	t->donatedPrior = -1;
 	t->waiting_lock = NULL;
-	list_init(&t->donors);
+	heap_init(&t->donor_locks, donor_lock_less, NULL);
+	t->waiting_sema = NULL;
 
 	// 2-3 Syscalls
 	list_init(&t->child_list);
@@ -500,6 +657,10 @@ init_thread(struct thread *t, const char *name, int priority)
 
 	// 2-5
 	t->running = NULL;
+
+	enum intr_level old_level = intr_disable();
+	list_push_back(&all_list, &t->all_elem);
+	intr_set_level(old_level);
 }
 
 /* Chooses and returns the next thread to be scheduled.  Should
@@ -510,10 +671,23 @@ init_thread(struct thread *t, const char *name, int priority)
 static struct thread *
 next_thread_to_run(void)
 {
-	if (list_empty(&ready_list))
-		return idle_thread;
+	struct cpu *c = cpu_current();
+	struct thread *next;
+
+	spin_lock(&c->rq_lock);
+	if (c->ready_bitmap == 0)
+	{
+		next = c->idle_thread;
+		c->dry_cnt++;
+	}
 	else
-		return list_entry(list_pop_front(&ready_list), struct thread, elem);
+	{
+		next = list_entry(list_front(&c->ready_queues[ready_max_priority(c)]),
+						  struct thread, elem);
+		queue_remove(c, next);
+	}
+	spin_unlock(&c->rq_lock);
+	return next;
 }
 
 /* Use iretq to launch the thread */
@@ -696,27 +870,25 @@ allocate_tid(void)
 
 /* Project 1 */
 // 1-1 Alarm clock
-// comparator; sort by decreasing priority
-bool prior_cmp(const struct list_elem *a, const struct list_elem *b, void *aux)
+// File sleeping thread T into the wheel slot for its endTick - O(1)
+static void wheel_insert(struct thread *t)
 {
-	struct thread *thA = list_entry(a, struct thread, elem);
-	struct thread *thB = list_entry(b, struct thread, elem);
-	return thA->priority > thB->priority;
-};
-
-// comparator; sort by increasing endTick and decreasing priority
-bool endTick_prior_cmp(const struct list_elem *a, const struct list_elem *b, void *aux)
-{
-	struct thread *thA = list_entry(a, struct thread, elem);
-	struct thread *thB = list_entry(b, struct thread, elem);
-	if (thA->endTick == thB->endTick)
-	{
-		return thA->priority > thB->priority;
-	}
-	return thA->endTick < thB->endTick;
-};
+	int64_t when = t->endTick;
+	int64_t delta = when - wheel_now;
+	int level = 0;
+
+	ASSERT(delta >= 0);
+	while (level < WHEEL_LEVELS - 1 && delta >= (int64_t)1 << (WHEEL_BITS * (level + 1)))
+		level++;
+	// Deadlines past the top level's range wait in its farthest slot and
+	// are re-filed from there
+	if (delta >= (int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+		when = wheel_now + ((int64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+	list_push_back(&sleep_wheel[level][(when >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)], &t->elem);
+}
 
-// 1-1 Block current thread, insert_ordered into sleep list - O(N)
+// 1-1 Block current thread until timer tick 'endTick' - O(1)
 void sleep()
 {
 	struct thread *curr = thread_current();
@@ -726,99 +898,144 @@ void sleep()
 	ASSERT(curr->status == THREAD_RUNNING);
 
 	old_level = intr_disable();
-	if (curr != idle_thread)
-		list_insert_ordered(&sleep_list, &curr->elem, endTick_prior_cmp, NULL);
-	thread_block();
+	// endTick may have passed since the caller checked it
+	if (!is_idle(curr) && curr->endTick > wheel_now)
+	{
+		wheel_insert(curr);
+		thread_block();
+	}
+	curr->endTick = -1;
 	intr_set_level(old_level);
 }
 
-// 1-1 Wake-up front thread in sleep list (sorted) and return next minEndTick - O(1)
-int64_t wake_up()
+// 1-1 Return the first tick after the current one, up to 'limit', at
+// which wake_up() has work to do: a sleeper is due or higher-level slots
+// are re-filed
+int64_t thread_next_wakeup(int64_t limit)
 {
-	//ASSERT(intr_context()); // wake_up should've been called by timer_interrupt
 	ASSERT(intr_get_level() == INTR_OFF);
 
-	// Unblock and remove target from sleep_list
-	struct thread *target;
-	target = list_entry(list_pop_front(&sleep_list), struct thread, elem); // remove from 'sleep_list'
-	thread_unblock(target);												   // unblock and add to 'ready_list'
-	target->endTick = -1;
+	for (int64_t tick = wheel_now + 1; tick < limit; tick++)
+		if ((tick & (WHEEL_SLOTS - 1)) == 0 || !list_empty(&sleep_wheel[0][tick & (WHEEL_SLOTS - 1)]))
+			return tick;
+	return limit;
+}
 
-	// 1-2 Q. How to preempt after waking thread up?
-	// if (thread_current()->priority < target->priority){
-	// 	thread_yield();
-	// }
+// 1-1 Advance the wheel to tick 'now', waking every thread that is due
+void wake_up(int64_t now)
+{
+	//ASSERT(intr_context()); // wake_up should've been called by timer_interrupt
+	ASSERT(intr_get_level() == INTR_OFF);
 
-	// Get new minEndTick and return (-1 if no more threads sleeping)
-	if (list_empty(&sleep_list))
-		return -1;
-	else
+	while (wheel_now < now)
 	{
-		struct thread *th = list_entry(list_front(&sleep_list), struct thread, elem);
-		return th->endTick;
+		wheel_now++;
+
+		// Re-file the higher-level slots whose range starts at this tick
+		for (int level = 1; level < WHEEL_LEVELS; level++)
+		{
+			if (wheel_now & (((int64_t)1 << (WHEEL_BITS * level)) - 1))
+				break;
+			struct list *slot = &sleep_wheel[level][(wheel_now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+			while (!list_empty(slot))
+				wheel_insert(list_entry(list_pop_front(slot), struct thread, elem));
+		}
+
+		// Everything left in this level-0 slot is due now
+		struct list *slot = &sleep_wheel[0][wheel_now & (WHEEL_SLOTS - 1)];
+		while (!list_empty(slot))
+			thread_unblock(list_entry(list_pop_front(slot), struct thread, elem));
 	}
 }
 
 // 1-3
-// Start from thread 't', donate 'new_prior' down the nested lock
-void donateNested(struct thread *t, int new_prior)
+// Sets T's effective priority, moving T to its new ready queue if it is ready - O(1)
+void thread_change_priority(struct thread *t, int new_prior)
 {
-	if (t->waiting_lock == NULL || t->waiting_lock == 0)
-	{
-		list_sort(&ready_list, prior_cmp, NULL);
+	ASSERT(intr_get_level() == INTR_OFF);
+
+	if (t->priority == new_prior)
 		return;
-	}
 
-	struct thread *nxt = t->waiting_lock->holder; // next nested thread to donate
-	if (nxt->priority < new_prior)
+	if (t->status == THREAD_READY)
+	{
+		ready_remove(t);
+		t->priority = new_prior;
+		ready_push(t);
+	}
+	else
 	{
-		nxt->donatedPrior = new_prior;
-		nxt->priority = MAX(nxt->basePrior, nxt->donatedPrior);
-		donateNested(nxt, new_prior);
+		t->priority = new_prior;
+		// a waiter moves within its semaphore's heap, and if that is a
+		// lock's semaphore the change is donated on to the holder (nested)
+		if (t->status == THREAD_BLOCKED && t->waiting_sema != NULL)
+			sema_reprioritize(t->waiting_sema, t);
 	}
-	// if nested thread with higher donatedPrior met, return
-	// Because that thread should've donated higher priority down already
 }
 
-// check any donor threads for current thread and find max donation
-// if donors list is empty, then init val -1 is set
-void donateMultiple(struct thread *curr)
+// heap order of 'donor_locks': the lock with the highest waiter on top
+static bool donor_lock_less(const struct heap_elem *a, const struct heap_elem *b, void *aux UNUSED)
+{
+	return heap_entry(a, struct lock, elem)->max_prior < heap_entry(b, struct lock, elem)->max_prior;
+}
+
+// take T's donation from the top of 'donor_locks' - O(1)
+// if no held lock has waiters, then init val -1 is set
+void donateMultiple(struct thread *t)
 {
 	int maxDonation = -1;
 
-	if (!list_empty(&curr->donors))
-	{
-		// prior_cmp sorts by 'decreasing' priority, so use 'list_min', not 'list_max'
-		struct list_elem *de = list_min(&curr->donors, prior_cmp, NULL);
-		struct thread *t = list_entry(de, struct thread, d_elem);
-		maxDonation = t->priority;
-	}
+	if (!heap_empty(&t->donor_locks))
+		maxDonation = heap_entry(heap_top(&t->donor_locks), struct lock, elem)->max_prior;
 
-	curr->donatedPrior = maxDonation;
-	curr->priority = MAX(curr->basePrior, curr->donatedPrior);
+	t->donatedPrior = maxDonation;
+	thread_change_priority(t, MAX(t->basePrior, t->donatedPrior));
 }
 
 // 1-4 Advanced Scheduler
 // recent_cpu and load_avg values are stored in 17.14 fixed-point format
-// update every thread's recent_cpu
-void total_update_recentcpu()
+// Priorities are recomputed lazily: a thread is queued on mlfqs_dirty_list
+// when its recent_cpu changes, and total_update_priority() only visits
+// that list, moving each thread to its new ready queue in O(1).
+
+// remember that T needs its priority recomputed
+static void mlfqs_mark_dirty(struct thread *t)
 {
-	enum intr_level old_level = intr_disable();
+	if (!t->mlfqs_dirty)
+	{
+		t->mlfqs_dirty = true;
+		list_push_back(&mlfqs_dirty_list, &t->mlfqs_elem);
+	}
+}
 
+// charge the running thread for the current tick
+void thread_charge_recentcpu()
+{
 	struct thread *t = thread_current();
-	thread_update_recentcpu(t);
 
-	struct list_elem *e;
-	for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e))
-	{
-		struct thread *t = list_entry(e, struct thread, elem);
-		thread_update_recentcpu(t);
-	}
+	ASSERT(intr_get_level() == INTR_OFF);
+	if (is_idle(t))
+		return;
+	t->recent_cpu += f;
+	mlfqs_mark_dirty(t);
+}
 
-	for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e))
+// decay every thread's recent_cpu, once per second
+void total_update_recentcpu()
+{
+	enum intr_level old_level = intr_disable();
+
+	struct list_elem *e;
+	for (e = list_begin(&all_list); e != list_end(&all_list); e = list_next(e))
 	{
-		struct thread *t = list_entry(e, struct thread, elem);
+		struct thread *t = list_entry(e, struct thread, all_elem);
+		if (is_idle(t))
+			continue;
+		int old_recent = t->recent_cpu;
 		thread_update_recentcpu(t);
+		// threads with no cpu history and nice 0 stay put
+		if (t->recent_cpu != old_recent)
+			mlfqs_mark_dirty(t);
 	}
 
 	intr_set_level(old_level);
@@ -838,7 +1055,9 @@ void thread_update_recentcpu(struct thread *t)
 void update_load_avg()
 {
 	struct thread *t = thread_current();
-	int ready_threads = list_size(&ready_list) + (t != idle_thread ? 1 : 0);
+	int ready_threads = is_idle(t) ? 0 : 1;
+	for (int id = 0; id < cpu_cnt; id++)
+		ready_threads += cpus[id].ready_cnt;
 
 	// 59/60 are rounded to zero when stored to int
 	// Change coeff to fixed-pt rep
@@ -848,35 +1067,27 @@ void update_load_avg()
 	// perform fixed-pt multiplication with coeffs
 }
 
-// update every thread's priority. This function should be called just before thread_tick so we don't need to consider preemption
+// update the priority of every thread whose recent_cpu changed. Called from the timer interrupt every four ticks
 void total_update_priority()
 {
 	enum intr_level old_level = intr_disable();
 
-	struct thread *t = thread_current();
-	thread_update_priority(t);
-
-	struct list_elem *e;
-	for (e = list_begin(&ready_list); e != list_end(&ready_list); e = list_next(e))
+	while (!list_empty(&mlfqs_dirty_list))
 	{
-		struct thread *t = list_entry(e, struct thread, elem);
+		struct thread *t = list_entry(list_pop_front(&mlfqs_dirty_list), struct thread, mlfqs_elem);
+		t->mlfqs_dirty = false;
 		thread_update_priority(t);
+		mlfqs_updates++;
 	}
-	// sorting ready_list again -> is list.sort preserves round-robin order?
-	list_sort(&ready_list, prior_cmp, NULL);
 
-	for (e = list_begin(&sleep_list); e != list_end(&sleep_list); e = list_next(e))
-	{
-		struct thread *t = list_entry(e, struct thread, elem);
-		thread_update_priority(t);
-	}
-	// sorting sleep_list again
-	list_sort(&sleep_list, endTick_prior_cmp, NULL);
+	// a ready thread may now outrank the running one
+	if (intr_context() && thread_get_priority() < ready_max_priority(cpu_current()))
+		intr_yield_on_return();
 
 	intr_set_level(old_level);
 }
 
-// update single thread's priority
+// update single thread's priority, requeueing it if it is ready
 void thread_update_priority(struct thread *t)
 {
 	// Change recent_cpu/4 to integer
@@ -884,5 +1095,6 @@ void thread_update_priority(struct thread *t)
 	recent = recent >= 0 ? (recent + (f / 2)) / f
 						 : (recent - (f / 2)) / f;
 
-	t->priority = PRI_MAX - recent - (t->nice * 2);
+	// Clamp so the priority always names one of the ready queues
+	thread_change_priority(t, MIN(PRI_MAX, MAX(PRI_MIN, PRI_MAX - recent - (t->nice * 2))));
 }
@@ -951,6 +951,17 @@ load_segment(struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+		/* A page of nothing but BSS needs no loading: it starts out on the
+		 * shared zero page (see vm/zero.c). */
+		if (page_read_bytes == 0)
+		{
+			if (!vm_alloc_page(VM_ANON, upage, writable))
+				return false;
+			zero_bytes -= page_zero_bytes;
+			upage += PGSIZE;
+			continue;
+		}
+
 		/* TODO: Set up aux to pass information to the lazy_load_segment. */
 		struct lazy_load_info *lazy_load_info = malloc(sizeof(struct lazy_load_info));
 		lazy_load_info->file = file;
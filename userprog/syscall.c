@@ -7,11 +7,14 @@
 #include "userprog/gdt.h"
 #include "userprog/process.h"
 #include "userprog/syscall.h"
+#include "devices/timer.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #include <list.h>
 #include <stdio.h>
 #include <syscall-nr.h>
+#include <vmstat.h>
 #include "intrinsic.h"
 #include "vm/vm.h"
 
@@ -39,6 +42,7 @@ void close(int fd);
 int dup2(int oldfd, int newfd);
 void *mmap (void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap (void *addr);
+bool vmstat (struct vmstat *st);
 
 //#define DEBUG
 
@@ -66,9 +70,6 @@ void syscall_init(void)
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			  FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
-
-	// Project 2-4. File descriptor
-	lock_init(&file_rw_lock);
 }
 
 /* The main system call interface */
@@ -135,6 +136,12 @@ void syscall_handler(struct intr_frame *f)
 	case SYS_MUNMAP:
 		munmap(f->R.rdi);
 		break;
+	case SYS_CLOCK:
+		f->R.rax = timer_now_ns();
+		break;
+	case SYS_VMSTAT:
+		f->R.rax = vmstat((struct vmstat *)f->R.rdi);
+		break;
 	default:
 		printf("(syscall_handler) Invalid syscall\n");
 		exit(-1);
@@ -318,12 +325,12 @@ int read(int fd, void *buffer, unsigned size)
 	}
 	else
 	{
-		// Q. read는 동시접근 허용해도 되지 않을까?
-		// > 아마 write와의 mutual_exclusion 위해서 같은 rw_lock 쓰는 듯
-		// readers-writer problem 참고
-		lock_acquire(&file_rw_lock);
+		// Readers of a file share its inode's lock, so they overlap
+		// with each other and with I/O on any other file
+		struct rwlock *rw = inode_get_rwlock(file_get_inode(fileobj));
+		rwlock_acquire_read(rw);
 		ret = file_read(fileobj, buffer, size);
-		lock_release(&file_rw_lock);
+		rwlock_release_read(rw);
 	}
 	return ret;
 }
@@ -362,9 +369,11 @@ int write(int fd, const void *buffer, unsigned size)
 	}
 	else
 	{
-		lock_acquire(&file_rw_lock);
+		// A writer excludes only readers and writers of the same file
+		struct rwlock *rw = inode_get_rwlock(file_get_inode(fileobj));
+		rwlock_acquire_write(rw);
 		ret = file_write(fileobj, buffer, size);
-		lock_release(&file_rw_lock);
+		rwlock_release_write(rw);
 	}
 
 	return ret;
@@ -499,4 +508,16 @@ void *mmap (void *addr, size_t length, int writable, int fd, off_t offset){
 // Project 3-3 mmap
 void munmap (void *addr){
 	do_munmap(addr);
-}
\ No newline at end of file
+}
+// Extra - copies the VM statistics of this process and of the system to ST.
+// Returns false if the kernel was built without virtual memory.
+bool vmstat (struct vmstat *st){
+	check_address((uint64_t *)st);
+	check_address((uint64_t *)((uint8_t *)st + sizeof *st - 1));
+#ifdef VM
+	vm_get_stats(st);
+	return true;
+#else
+	return false;
+#endif
+}
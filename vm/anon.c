@@ -1,7 +1,12 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
+#include <stdio.h>
+#include <string.h>
 #include "vm/vm.h"
 #include "devices/disk.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 
 // #define DBG
 //#define DBG_swap
@@ -13,6 +18,28 @@ static struct disk *swap_disk; // #ifdef DBG Q. 이게 뭐임?
 
 const int SECTORS_IN_PAGE = 8; // 4kB / 512 (DISK_SECTOR_SIZE)
 
+// Project 3 - Copy-on-write : a frame shared after fork is swapped out once,
+// so every sharer points at the same slot. The slot is freed with its last reader.
+static uint16_t *swap_slot_ref; // # of anon pages whose contents live in each swap slot
+static struct lock swap_lock; // protects swap_table and swap_slot_ref
+
+// Project 3 - Swap readahead : a swap-in fault also reads the following slots
+// when they hold the following virtual pages of the same process. They wait in
+// ra_buf until they fault in themselves or their slot is reused.
+#define SWAP_RA_PAGES 8 // most pages read by one swap-in, the faulting one included
+#define SWAP_CLUSTER 8 // free run a process's cursor jumps to when its next slot is taken
+
+static struct lock ra_lock; // protects the readahead window and counters below
+static uint8_t *ra_buf; // SWAP_RA_PAGES pages; page i holds slot ra_slot + i
+static size_t ra_slot; // slot of ra_buf's first page
+static unsigned ra_valid; // bit i set if ra_buf's page i is still good
+
+/* Statistics. */
+static long long swap_in_cnt; // # of pages swapped in
+static long long swap_out_cnt; // # of pages swapped out
+static long long ra_cnt; // # of pages read ahead
+static long long ra_hit_cnt; // # of swap-ins served from ra_buf
+
 static bool anon_swap_in (struct page *page, void *kva);
 static bool anon_swap_out (struct page *page);
 static void anon_destroy (struct page *page);
@@ -37,6 +64,103 @@ vm_anon_init (void) {
 
 	bitcnt = disk_size(swap_disk)/SECTORS_IN_PAGE; // #ifdef Q. disk size decided by swap-size option?
 	swap_table = bitmap_create(bitcnt); // each bit = swap slot for a frame
+	swap_slot_ref = calloc(bitcnt, sizeof *swap_slot_ref);
+	lock_init(&swap_lock);
+
+	lock_init(&ra_lock);
+	ra_buf = palloc_get_multiple(PAL_ASSERT, SWAP_RA_PAGES);
+	ra_valid = 0;
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	printf("Swap: %lld pages out, %lld pages in, %lld read ahead, %lld readahead hits",
+			swap_out_cnt, swap_in_cnt, ra_cnt, ra_hit_cnt);
+	if (ra_cnt > 0)
+		printf(" (%lld%%)", ra_hit_cnt * 100 / ra_cnt);
+	printf("\n");
+}
+
+/* Allocates a swap slot for a page of the process whose memory is SPT.
+ * Slots are handed out from the process's cursor so that pages it loses
+ * to eviction one after another end up next to each other on disk; when
+ * the slot under the cursor is taken, the cursor moves to a free run of
+ * SWAP_CLUSTER slots, or to any free slot if there is no such run. */
+static size_t
+swap_slot_alloc (struct supplemental_page_table *spt) {
+	size_t slot = spt->swap_cursor;
+
+	lock_acquire(&swap_lock);
+	if (slot >= (size_t) bitcnt || bitmap_test(swap_table, slot)) {
+		slot = bitmap_scan(swap_table, spt->swap_cursor, SWAP_CLUSTER, false);
+		if (slot == BITMAP_ERROR)
+			slot = bitmap_scan(swap_table, 0, SWAP_CLUSTER, false);
+		if (slot == BITMAP_ERROR)
+			slot = bitmap_scan(swap_table, 0, 1, false);
+		if (slot == BITMAP_ERROR)
+			PANIC("(anon swap-out) No more free swap slots!\n");
+	}
+	bitmap_mark(swap_table, slot);
+	lock_release(&swap_lock);
+
+	spt->swap_cursor = slot + 1;
+	return slot;
+}
+
+/* Drops one reference to the swap slot starting at SWAP_SEC and frees the
+ * slot when no page refers to it anymore. */
+static void
+swap_slot_put (int swap_sec) {
+	int swap_slot_idx = swap_sec / SECTORS_IN_PAGE;
+
+	lock_acquire(&swap_lock);
+	ASSERT (swap_slot_ref[swap_slot_idx] > 0);
+	if (--swap_slot_ref[swap_slot_idx] == 0)
+		bitmap_set(swap_table, swap_slot_idx, 0);
+	lock_release(&swap_lock);
+}
+
+/* Makes DST, an anonymous page of a forked child, share the swap slot
+ * holding SRC's contents. */
+void
+anon_share_swap (struct page *dst, struct page *src) {
+	int swap_sec = src->anon.swap_sec;
+
+	dst->anon.swap_sec = swap_sec;
+	if (swap_sec != -1){
+		lock_acquire(&swap_lock);
+		swap_slot_ref[swap_sec / SECTORS_IN_PAGE]++;
+		lock_release(&swap_lock);
+	}
+}
+
+/* Returns the number of pages, starting with PAGE in swap slot SLOT,
+ * whose contents sit in consecutive slots: page i of the run is the
+ * i-th virtual page after PAGE, of the same process, not in memory,
+ * and stored in slot SLOT + i. At most SWAP_RA_PAGES. */
+static size_t
+ra_run_length (struct page *page, size_t slot) {
+	struct supplemental_page_table *spt = &page->owner->spt;
+	size_t n;
+
+	for (n = 1; n < SWAP_RA_PAGES; n++) {
+		struct page *next = spt_find_page(spt, page->va + n * PGSIZE);
+
+		if (next == NULL || next->operations != &anon_ops || next->frame != NULL
+				|| next->anon.swap_sec != (int) ((slot + n) * SECTORS_IN_PAGE))
+			break;
+	}
+	return n;
+}
+
+/* Forgets the read-ahead copy of SLOT, whose contents are about to change. */
+static void
+ra_invalidate (size_t slot) {
+	lock_acquire(&ra_lock);
+	if (slot >= ra_slot && slot < ra_slot + SWAP_RA_PAGES)
+		ra_valid &= ~(1u << (slot - ra_slot));
+	lock_release(&ra_lock);
 }
 
 /* Initialize the file mapping */
@@ -74,16 +198,39 @@ anon_swap_in (struct page *page, void *kva) {
 // #endif
 	page->frame->kva = kva;
 
-	bitmap_set(swap_table, swap_slot_idx, 0);
-
 	// ASSERT(is_writable(kva) != false);
 
-	// disk_read is done per sector; repeat until one page is read
-	for(int sec = 0; sec < SECTORS_IN_PAGE; sec++)
-		disk_read(swap_disk, swap_sec + sec, page->frame->kva + DISK_SECTOR_SIZE * sec);
-	
-	// restore vaddr connection
-	pml4_set_page(thread_current()->pml4, page->va, kva, true); // writable true, as we are writing into the frame
+	size_t slot = swap_slot_idx;
+	vm_stat_count(VMSTAT_SWAP_INS);
+	lock_acquire(&ra_lock);
+	swap_in_cnt++;
+	if (slot >= ra_slot && slot < ra_slot + SWAP_RA_PAGES
+			&& (ra_valid & (1u << (slot - ra_slot)))){
+		// read ahead by an earlier fault
+		memcpy(kva, ra_buf + (slot - ra_slot) * PGSIZE, PGSIZE);
+		ra_valid &= ~(1u << (slot - ra_slot));
+		ra_hit_cnt++;
+	}
+	else{
+		size_t n = ra_run_length(page, slot);
+
+		if (n == 1)
+			// read the whole page with a single multi-sector command
+			disk_read_sectors(swap_disk, swap_sec, SECTORS_IN_PAGE, kva);
+		else{
+			// read the run with a single command; keep all but the first page for later
+			disk_read_sectors(swap_disk, swap_sec, n * SECTORS_IN_PAGE, ra_buf);
+			memcpy(kva, ra_buf, PGSIZE);
+			ra_slot = slot;
+			ra_valid = ((1u << n) - 1) & ~1u;
+			ra_cnt += n - 1;
+		}
+	}
+	lock_release(&ra_lock);
+
+	// vaddr connection is restored by vm_do_claim_page with the page's own permission;
+	// free the slot only after reading it, and only once no other sharer needs it
+	swap_slot_put(swap_sec);
 
 	anon_page->swap_sec = -1;
 	return true;
@@ -92,15 +239,17 @@ anon_swap_in (struct page *page, void *kva) {
 /* Swap out the page by writing contents to the swap disk. */
 static bool
 anon_swap_out (struct page *page) {
-	struct anon_page *anon_page = &page->anon;
+	struct frame *frame = page->frame;
+	struct page *sharer;
+	struct list_elem *e;
 
-	// Find free slot in swap disk
+	// Find free slot in swap disk, next to the owner's previous ones
 	// Need at least PGSIZE to store frame into the slot 
 	// size_t free_idx = bitmap_scan(swap_table, 0, SECTORS_IN_PAGE, 0);
-	size_t free_idx = bitmap_scan_and_flip(swap_table, 0, 1, 0);
-
-	if(free_idx == BITMAP_ERROR)
-		PANIC("(anon swap-out) No more free swap slots!\n");
+	size_t free_idx = swap_slot_alloc(&page->owner->spt);
+	ra_invalidate(free_idx);
+	swap_out_cnt++;
+	vm_stat_count(VMSTAT_SWAP_OUTS);
 
 #ifdef DBG_swap
 	printf("(anon_swap_out) page %p - frame %p\n", page->va, page->frame->kva);
@@ -108,17 +257,25 @@ anon_swap_out (struct page *page) {
 
 	int swap_sec = free_idx * SECTORS_IN_PAGE;
 
-	// disk_write is done per sector; repeat until one page is written
-	for(int sec = 0; sec < SECTORS_IN_PAGE; sec++)
-		disk_write(swap_disk, swap_sec + sec, page->frame->kva + DISK_SECTOR_SIZE * sec);
-
-	// access to page now generates fault
-	pml4_clear_page(thread_current()->pml4, page->va);
-
-	anon_page->swap_sec = swap_sec;
-
-	page->frame->page = NULL;
-	page->frame = NULL;
+	// access to page now generates fault; the victim may belong to another process.
+	// Unmap it everywhere before writing, or a store during the write would be lost;
+	// a sharer that faults meanwhile waits in vm_try_handle_fault for the evictor.
+	// The evictor pinned the frame, so no sharer can join or leave meanwhile.
+	for(e = list_begin(&frame->pages); e != list_end(&frame->pages); e = list_next(e)){
+		sharer = list_entry(e, struct page, frame_elem);
+		pml4_clear_page(sharer->owner->pml4, sharer->va);
+	}
+
+	// write the whole page with a single multi-sector command
+	disk_write_sectors(swap_disk, swap_sec, SECTORS_IN_PAGE, frame->kva);
+
+	while((sharer = frame->page) != NULL){
+		sharer->anon.swap_sec = swap_sec;
+		lock_acquire(&swap_lock);
+		swap_slot_ref[free_idx]++;
+		lock_release(&swap_lock);
+		frame_unlink(sharer);
+	}
 
 	return true;
 }
@@ -127,4 +284,7 @@ anon_swap_out (struct page *page) {
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if(anon_page->swap_sec != -1)
+		swap_slot_put(anon_page->swap_sec);
 }
@@ -75,7 +75,7 @@ static bool
 file_backed_swap_out (struct page *page) {
 	struct file_page *file_page = &page->file;
 	void *addr = page->va;
-	struct thread *t = thread_current();
+	struct thread *t = page->owner; // the victim may belong to another process
 
 	if(pml4_is_dirty(t->pml4, addr)){
 		struct file *file = file_page->file;
@@ -85,6 +85,7 @@ file_backed_swap_out (struct page *page) {
 		#ifdef DBG_swap
 			printf("(file_swap_out) writeback happened");
 		#endif
+		vm_stat_count(VMSTAT_FILE_WRITEBACKS);
 		if(file_write_at(file, kva, length, offset) != length){
 			// #ifdef DBG
 			// TODO - Not properly written-back
@@ -97,8 +98,7 @@ file_backed_swap_out (struct page *page) {
 
 	// access to page now generates fault
 	pml4_clear_page(t->pml4, addr);
-	page->frame->page = NULL;
-	page->frame = NULL;
+	frame_unlink(page);
 	return true;
 }
 
@@ -238,6 +238,7 @@ do_munmap (void *addr) {
 			size_t length = page->file.length;
 			off_t offset = page->file.offset;
 
+			vm_stat_count(VMSTAT_FILE_WRITEBACKS);
 			if(file_write_at(file, addr, length, offset) != length){
 				// #ifdef DBG
 				// TODO - Not properly written-back
@@ -10,6 +10,7 @@
 
 #include "vm/vm.h"
 #include "vm/uninit.h"
+#include "threads/malloc.h"
 
 //#define DBG
 
@@ -72,8 +73,8 @@ uninit_destroy (struct page *page) {
 	/* TODO: Fill this function.
 	 * TODO: If you don't have anything to do, just return. */
 	struct lazy_load_info * info = (struct lazy_load_info *)(uninit->aux);
-	file_close(&info->file);
-	
-	// 'file_close' frees 'info'
-	//free(info); // malloc in 'process.c load_segment' or 'hash_action_copy'
+
+	// The file is shared with the process (load_segment) or left open like
+	// that of a page that did fault in (lazy_load_segment); only the aux goes.
+	free(info); // malloc in 'process.c load_segment' or 'hash_action_copy'
 }
@@ -1,8 +1,15 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/interrupt.h"
+#include "devices/timer.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/zero.h"
 
 
 //#define DBG
@@ -10,6 +17,31 @@
 //#define DBG_swap
 
 
+/* Eviction policy; clock unless "-evict=fifo" is given at boot. */
+enum evict_policy evict_policy = EVICT_CLOCK;
+
+static struct lock frame_lock;			/* Protects frame_table, clock_hand and
+										   each frame's pages and pinned flag. */
+static struct list_elem *clock_hand;	/* Next frame the eviction scan looks at. */
+static struct condition unpinned;		/* Signaled whenever a frame is unpinned. */
+
+/* Statistics. */
+static long long vm_counters[VMSTAT_COUNTER_CNT];	/* All processes; see vm_stat_count. */
+static long long fault_kind_cnt[VMSTAT_FAULT_CNT];	/* # of faults resolved, by kind. */
+static long long fault_latency[VMSTAT_FAULT_CNT][VMSTAT_BUCKETS]; /* ...by kind and time taken. */
+static long long frame_alloc_cnt;	/* # of frames handed out by vm_get_frame. */
+static long long fork_cnt;		/* # of address spaces copied by fork. */
+static long long fork_frame_cnt;	/* # of frames allocated while copying them. */
+static long long cow_share_cnt;	/* # of frames shared copy-on-write by fork. */
+static long long cow_copy_cnt;	/* # of shared frames copied on a write fault. */
+
+static struct frame *frame_pin (struct page *page);
+static void frame_unpin (struct frame *frame);
+static void frame_free (struct frame *frame);
+static void clock_advance (void);
+static void page_detach_frame (struct page *page);
+static void register_frame_inspect_intr (void);
+
 #ifdef DBG
 // Print out elements in struct hash
 void hash_action_func_print (struct hash_elem *e, void *aux){
@@ -25,9 +57,7 @@ void remove_page(struct page *page){
 	pml4_clear_page(t->pml4, page->va);
 	// if(page->frame)
 	// 	free(page->frame);
-	if (page->frame != NULL){
-		page->frame->page = NULL;
-	}
+	page_detach_frame(page);
 	vm_dealloc_page (page);
 	// destroy(page); // uninit destroy - free aux
 	// free(page);
@@ -37,8 +67,11 @@ void remove_page(struct page *page){
  * intialize codes. */
 void
 vm_init (void) {
+	page_slab = slab_cache_create ("page", sizeof (struct page), NULL);
+	frame_slab = slab_cache_create ("frame", sizeof (struct frame), NULL);
 	vm_anon_init ();
 	vm_file_init ();
+	vm_zero_init ();
 #ifdef EFILESYS  /* For project 4 */
 	pagecache_init ();
 #endif
@@ -46,6 +79,187 @@ vm_init (void) {
 	/* DO NOT MODIFY UPPER LINES. */
 	/* TODO: Your code goes here. */
 	list_init(&frame_table);
+	lock_init(&frame_lock);
+	cond_init(&unpinned);
+	clock_hand = NULL;
+	register_frame_inspect_intr();
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void) {
+	static const char *kind_names[VMSTAT_FAULT_CNT] = {
+		"zero", "anon", "cow", "exec", "file", "swap",
+	};
+	int kind, bucket;
+
+	printf ("VM: %lld minor faults, %lld major faults, %lld stack growths, "
+			"%lld evictions (%s)\n", vm_counters[VMSTAT_MINOR_FAULTS],
+			vm_counters[VMSTAT_MAJOR_FAULTS], vm_counters[VMSTAT_STACK_GROWTHS],
+			vm_counters[VMSTAT_EVICTIONS],
+			evict_policy == EVICT_CLOCK ? "clock" : "fifo");
+	printf ("VM: %lld swap ins, %lld swap outs, %lld file writebacks\n",
+			vm_counters[VMSTAT_SWAP_INS], vm_counters[VMSTAT_SWAP_OUTS],
+			vm_counters[VMSTAT_FILE_WRITEBACKS]);
+	for (kind = 0; kind < VMSTAT_FAULT_CNT; kind++) {
+		if (fault_kind_cnt[kind] == 0)
+			continue;
+		printf ("VM: %lld %s faults by latency:", fault_kind_cnt[kind],
+				kind_names[kind]);
+		for (bucket = 0; bucket < VMSTAT_BUCKETS; bucket++)
+			if (fault_latency[kind][bucket] != 0) {
+				if (bucket < VMSTAT_BUCKETS - 1)
+					printf (" <%dus %lld", 1 << bucket, fault_latency[kind][bucket]);
+				else
+					printf (" >=%dus %lld", 1 << (bucket - 1),
+							fault_latency[kind][bucket]);
+			}
+		printf ("\n");
+	}
+	printf ("VM: %lld forks, %lld frames allocated by fork, "
+			"%lld frames shared, %lld copied on write\n",
+			fork_cnt, fork_frame_cnt, cow_share_cnt, cow_copy_cnt);
+	zero_print_stats ();
+	anon_print_stats ();
+#ifdef EFILESYS
+	page_cache_print_stats ();
+#endif
+}
+
+/* Counts one COUNTER event against the current process and the system.
+ * Evictions and swapping are charged to whoever's fault caused them. */
+void
+vm_stat_count (enum vmstat_counter counter) {
+	thread_current ()->vm_counters[counter]++;
+	vm_counters[counter]++;
+}
+
+/* Accounts for a fault of KIND, begun at TSC time START, that is now
+ * resolved. */
+static void
+vm_stat_fault (enum vmstat_fault kind, uint64_t start) {
+	int64_t us = timer_cycles_to_ns (timer_cycles () - start) / 1000;
+	int bucket = 0;
+
+	while (bucket < VMSTAT_BUCKETS - 1 && us >= 1 << bucket)
+		bucket++;
+	fault_kind_cnt[kind]++;
+	fault_latency[kind][bucket]++;
+	vm_stat_count (kind == VMSTAT_FAULT_EXEC || kind == VMSTAT_FAULT_FILE
+			|| kind == VMSTAT_FAULT_SWAP ? VMSTAT_MAJOR_FAULTS
+			: VMSTAT_MINOR_FAULTS);
+}
+
+/* Copies the current process's and the system's VM statistics to ST. */
+void
+vm_get_stats (struct vmstat *st) {
+	memcpy (st->proc, thread_current ()->vm_counters, sizeof st->proc);
+	memcpy (st->global, vm_counters, sizeof st->global);
+	memcpy (st->faults, fault_kind_cnt, sizeof st->faults);
+	memcpy (st->latency, fault_latency, sizeof st->latency);
+}
+
+static void
+inspect_frame_cnt (struct intr_frame *f) {
+	f->R.rax = frame_alloc_cnt;
+}
+
+/* Tool for testing copy-on-write. Calling this function via int 0x45.
+ * Output:
+ *   @RAX - Number of frames handed out to user pages since boot. */
+static void
+register_frame_inspect_intr (void) {
+	intr_register_int (0x45, 3, INTR_OFF, inspect_frame_cnt, "Inspect Frame Count");
+}
+
+/* Makes PAGE one of the pages mapping FRAME. */
+void
+frame_link (struct frame *frame, struct page *page) {
+	lock_acquire (&frame_lock);
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+	frame->page = list_entry (list_front (&frame->pages), struct page, frame_elem);
+	page->frame = frame;
+	lock_release (&frame_lock);
+}
+
+/* Removes PAGE from the pages mapping its frame. The frame is free once
+ * the last page leaves it; whoever holds it pinned then either reuses it
+ * or gives it back with frame_free. */
+void
+frame_unlink (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (frame != NULL);
+
+	lock_acquire (&frame_lock);
+	list_remove (&page->frame_elem);
+	frame->ref_cnt--;
+	frame->page = list_empty (&frame->pages) ? NULL
+		: list_entry (list_front (&frame->pages), struct page, frame_elem);
+	page->frame = NULL;
+	lock_release (&frame_lock);
+}
+
+/* Pins the frame holding PAGE so that eviction leaves it alone, first
+ * waiting out an eviction that already has it. Returns NULL if PAGE is
+ * not in memory. */
+static struct frame *
+frame_pin (struct page *page) {
+	struct frame *frame;
+
+	lock_acquire (&frame_lock);
+	while ((frame = page->frame) != NULL && frame->pinned)
+		cond_wait (&unpinned, &frame_lock);
+	if (frame != NULL)
+		frame->pinned = true;
+	lock_release (&frame_lock);
+	return frame;
+}
+
+/* Lets eviction have FRAME again. */
+static void
+frame_unpin (struct frame *frame) {
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	cond_broadcast (&unpinned, &frame_lock);
+	lock_release (&frame_lock);
+}
+
+/* Takes FRAME, which is pinned and no longer maps any page, out of the
+ * frame table and gives its memory back to the user pool. */
+static void
+frame_free (struct frame *frame) {
+	ASSERT (frame->pinned && frame->ref_cnt == 0);
+
+	lock_acquire (&frame_lock);
+	if (clock_hand == &frame->elem) {
+		clock_advance ();
+		if (clock_hand == &frame->elem)
+			clock_hand = NULL;
+	}
+	list_remove (&frame->elem);
+	cond_broadcast (&unpinned, &frame_lock);
+	lock_release (&frame_lock);
+
+	palloc_free_page (frame->kva);
+	slab_free (frame_slab, frame);
+	zero_pool_kick ();
+}
+
+/* Breaks the link between PAGE and its frame, if any, freeing the frame
+ * if PAGE was the last page mapping it. */
+static void
+page_detach_frame (struct page *page) {
+	struct frame *frame = frame_pin (page);
+
+	if (frame != NULL) {
+		frame_unlink (page);
+		if (frame->ref_cnt == 0)
+			frame_free (frame);
+		else
+			frame_unpin (frame);
+	}
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -62,6 +276,29 @@ page_get_type (struct page *page) {
 	}
 }
 
+/* Returns true if PAGE has never been in memory and has nothing to load,
+ * so that its contents are all zeros: a stack page, or a page of BSS. */
+static bool
+page_is_zero_fill (struct page *page) {
+	return page->operations->type == VM_UNINIT && page->uninit.init == NULL
+		&& VM_TYPE (page->uninit.type) == VM_ANON;
+}
+
+/* Returns the kind of fault PAGE is taking: a write if WRITE, to a page
+ * that is mapped, if read-only, unless NOT_PRESENT. */
+static enum vmstat_fault
+page_fault_kind (struct page *page, bool write, bool not_present) {
+	if (page_is_zero_fill (page))
+		return write ? VMSTAT_FAULT_ANON : VMSTAT_FAULT_ZERO;
+	if (!not_present)
+		return VMSTAT_FAULT_COW;
+	if (page->operations->type == VM_UNINIT)
+		return VM_TYPE (page->uninit.type) == VM_FILE ? VMSTAT_FAULT_FILE
+			: VMSTAT_FAULT_EXEC;
+	return page_get_type (page) == VM_FILE ? VMSTAT_FAULT_FILE
+		: VMSTAT_FAULT_SWAP;
+}
+
 /* Helpers */
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
@@ -94,11 +331,12 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 				break;
 		}
 		
-		struct page *new_page = malloc(sizeof(struct page));
+		struct page *new_page = slab_alloc(page_slab);
 		uninit_new (new_page, upage, init, type, aux, initializer);
 
 		new_page->writable = writable;
 		new_page->page_cnt = -1; // only for file-mapped pages
+		new_page->owner = thread_current();
 
 		/* TODO: Insert the page into the spt. */
 		spt_insert_page(spt, new_page); // should always return true - checked that upage is not in spt
@@ -150,25 +388,98 @@ spt_insert_page (struct supplemental_page_table *spt UNUSED,
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	pml4_clear_page(thread_current()->pml4, page->va);
 	hash_delete(&spt->spt_hash, &page->hash_elem);
-	
-	// if(page->frame)
-	// 	free(page->frame);
-	if (page->frame != NULL){
-		page->frame->page = NULL;
+	remove_page(page);
+}
+
+/* Returns true if any mapping of FRAME has its accessed bit set. */
+static bool
+frame_is_accessed (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 != NULL && pml4_is_accessed (pml4, page->va))
+			return true;
 	}
-	vm_dealloc_page (page);
+	return false;
+}
 
-	return true;
+/* Clears the accessed bit in every mapping of FRAME. */
+static void
+frame_clear_accessed (struct frame *frame) {
+	struct list_elem *e;
+
+	for (e = list_begin (&frame->pages); e != list_end (&frame->pages);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, frame_elem);
+		uint64_t *pml4 = page->owner->pml4;
+
+		if (pml4 != NULL)
+			pml4_set_accessed (pml4, page->va, false);
+	}
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Moves the clock hand to the next frame, wrapping around at the
+ * end of the frame table. */
+static void
+clock_advance (void) {
+	clock_hand = list_next (clock_hand);
+	if (clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+}
+
+/* Get the struct frame, that will be evicted.
+ * Frames stay in frame_table in the order they were made until they are
+ * freed, so FIFO is just the clock hand sweeping without looking at the
+ * accessed bits; the clock policy gives every recently used frame a
+ * second chance. Two
+ * full sweeps always find a victim because the first one clears every
+ * accessed bit it passes. Pinned frames are skipped; if a whole sweep
+ * meets nothing but pinned frames, which a small user pool makes
+ * possible, waits for one to be unpinned and starts over, or returns
+ * NULL if the frames it waited on were all freed meanwhile. The victim
+ * comes back pinned. */
 static struct frame *
 vm_get_victim (void) {
 	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
-	victim = list_entry(list_pop_front(&frame_table), struct frame, elem); // FIFO algorithm
+	size_t frame_cnt = list_size (&frame_table);
+	size_t scan_limit = 2 * frame_cnt;
+	size_t pinned_run = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (!list_empty (&frame_table));
+
+	while (victim == NULL) {
+		struct frame *frame;
+
+		if (clock_hand == NULL)
+			clock_hand = list_begin (&frame_table);
+		frame = list_entry (clock_hand, struct frame, elem);
+		clock_advance ();
+
+		if (frame->pinned) {
+			if (++pinned_run == frame_cnt) {
+				cond_wait (&unpinned, &frame_lock);
+				if (list_empty (&frame_table))
+					return NULL;
+				frame_cnt = list_size (&frame_table);
+				scan_limit = 2 * frame_cnt;
+				pinned_run = 0;
+			}
+			continue;
+		}
+		pinned_run = 0;
+		if (evict_policy == EVICT_FIFO || scan_limit-- == 0
+				|| !frame_is_accessed (frame))
+			victim = frame;
+		else
+			frame_clear_accessed (frame);
+	}
+	victim->pinned = true;
 	return victim;
 }
 
@@ -176,18 +487,42 @@ vm_get_victim (void) {
  * Return NULL on error.*/
 static struct frame *
 vm_evict_frame (void) {
+	lock_acquire(&frame_lock);
 	struct frame *victim = vm_get_victim();
+	lock_release(&frame_lock);
+	if (victim == NULL)
+		return NULL;
 	/* TODO: swap out the victim and return the evicted frame. */
 	#ifdef DBG_swap
 		printf("(vm_evict_frame) frame %p(page %p) selected and now swapping out\n", victim->kva, victim->page->va);
 	#endif
 	if(victim->page != NULL){
 		swap_out(victim->page);
+		vm_stat_count(VMSTAT_EVICTIONS);
 	}
 	// Manipulate swap table according to its design
 	return victim;
 }
 
+/* Makes a frame of the free user page at KVA and puts it in the frame
+ * table. The frame comes back pinned, until vm_do_claim_page is done
+ * with it. */
+static struct frame *
+frame_new (void *kva) {
+	struct frame *frame = slab_alloc(frame_slab); // #ifdef DEBUG - what if this fails?
+	frame->kva = kva;
+	frame->page = NULL;
+	list_init(&frame->pages);
+	frame->ref_cnt = 0;
+	frame->pinned = true;
+
+	// A frame stays in the frame table, recycled by eviction, until its last page goes away
+	lock_acquire(&frame_lock);
+	list_push_back(&frame_table, &frame->elem);
+	lock_release(&frame_lock);
+	return frame;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
@@ -197,6 +532,10 @@ vm_get_frame (void) {
 	/* TODO: Fill this function. */
 	void * kva = palloc_get_page(PAL_USER);
 	struct frame *frame = NULL;
+
+	// The zeroing thread may hold the last free pages; take one before evicting
+	if (kva == NULL)
+		kva = zero_pool_get();
 	if (kva == NULL){
 		// Todo... eviction
 		/*
@@ -214,17 +553,41 @@ vm_get_frame (void) {
 
 		-- 확실하진 않지만 일단 디자인이 이럼 --
 		*/
-		frame = vm_evict_frame();
-	}
-	else{
-		frame = malloc(sizeof(struct frame)); // #ifdef DEBUG - what if this fails?
-		frame->kva = kva;
+#ifdef EFILESYS
+		// Project 4 - take frames back from the page cache before evicting
+		if (page_cache_reclaim())
+			kva = palloc_get_page(PAL_USER);
+#endif
 	}
+	if (kva != NULL)
+		frame = frame_new(kva);
+	// The frames eviction waited on may all have been freed; take one of those
+	else if ((frame = vm_evict_frame()) == NULL)
+		return vm_get_frame();
 	// frame->page = malloc(sizeof(struct page));
 	// list_push_back(&frame_table, &frame->elem); // BUG - physical memory overlap; lazy_load_info offset and before->prev->next
 
 	ASSERT (frame != NULL);
 	// ASSERT (frame->page == NULL); // #ifdef DEBUG
+	frame_alloc_cnt++;
+	return frame;
+}
+
+/* Like vm_get_frame, but the frame comes back filled with zeros: one the
+ * zeroing thread prepared if there is one, or else any frame, zeroed now. */
+static struct frame *
+vm_get_zeroed_frame (void) {
+	void *kva = zero_pool_get();
+	struct frame *frame;
+
+	if (kva != NULL){
+		frame = frame_new(kva);
+		frame_alloc_cnt++;
+	}
+	else{
+		frame = vm_get_frame();
+		memset(frame->kva, 0, PGSIZE);
+	}
 	return frame;
 }
 
@@ -236,8 +599,33 @@ vm_stack_growth (void *addr UNUSED) {
 }
 
 /* Handle the fault on write_protected page */
+// Project 3 - Copy-on-write : PAGE is writable but mapped read-only because fork
+// shares its frame. The last sharer takes the frame back as is; any other
+// sharer moves to a private copy.
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	struct frame *frame = frame_pin(page);
+	uint64_t *pml4 = page->owner->pml4;
+
+	if (frame == NULL){
+		// evicted after the fault was taken, or still on the zero page
+		pml4_clear_page(pml4, page->va);
+		return vm_do_claim_page(page);
+	}
+
+	if (frame->ref_cnt > 1){
+		struct frame *copy = vm_get_frame();
+
+		memcpy(copy->kva, frame->kva, PGSIZE);
+		frame_unlink(page);
+		frame_link(copy, page);
+		frame_unpin(copy);
+		cow_copy_cnt++;
+	}
+	frame_unpin(frame);
+
+	pml4_clear_page(pml4, page->va); // flush the read-only TLB entry
+	return pml4_set_page(pml4, page->va, page->frame->kva, true);
 }
 
 /* Return true on success */
@@ -246,6 +634,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
 	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
 	struct page *page = NULL;
+	uint64_t start = timer_cycles(); // for the latency histograms
 	/* TODO: Validate the fault */
 	/* TODO: Your code goes here */
 
@@ -273,6 +662,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		if((uint64_t)addr > STACK_LIMIT && USER_STACK > (uint64_t)addr && (uint64_t)addr > (uint64_t)rsp - GROWTH_LIMIT){
 			vm_stack_growth (fpage_uvaddr);
 			fpage = spt_find_page(spt, fpage_uvaddr);
+			vm_stat_count(VMSTAT_STACK_GROWTHS);
 		}
 		else{
 			#ifdef DBG
@@ -294,6 +684,24 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 	}
 
 	ASSERT(fpage != NULL);
+	enum vmstat_fault kind = page_fault_kind(fpage, write, not_present);
+
+	// Read of a page that is still all zeros - share the zero page read-only
+	// until the first write, which vm_handle_wp then gives a frame of its own
+	if(!write && not_present && page_is_zero_fill(fpage)){
+		if(!pml4_set_page(thread_current()->pml4, fpage->va, zero_page(), false))
+			return false;
+		vm_stat_fault(kind, start);
+		return true;
+	}
+
+	// Project 3 - Copy-on-write : write to a present, writable page
+	if(write && !not_present){
+		bool handled = vm_handle_wp(fpage);
+		if (handled)
+			vm_stat_fault(kind, start);
+		return handled;
+	}
 
 #ifdef DBG
 	printf("-- Fault on page with va %p --\n", fpage->va);
@@ -304,6 +712,18 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 	printf("\n");
 #endif
 
+	// An eviction unmaps the page before writing its frame out; wait for it to
+	// finish, and map the frame again should the page still have it
+	struct frame *frame = frame_pin(fpage);
+	if(frame != NULL){
+		bool mapped = pml4_set_page(thread_current()->pml4, fpage->va, frame->kva,
+				fpage->writable && frame->ref_cnt == 1);
+		frame_unpin(frame);
+		if (mapped)
+			vm_stat_fault(kind, start);
+		return mapped;
+	}
+
 	// Step 2~4.
 	bool gotFrame = vm_do_claim_page (fpage);
 
@@ -313,7 +733,7 @@ vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 	#endif
 
 	if (gotFrame)
-		list_push_back(&frame_table, &fpage->frame->elem);
+		vm_stat_fault(kind, start);
 	#ifdef DBG_swap
 	else
 		printf("Fault at %p\n", page->va);
@@ -358,14 +778,14 @@ vm_claim_page (void *va UNUSED) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame = page_is_zero_fill (page) ? vm_get_zeroed_frame ()
+		: vm_get_frame ();
 
 	#ifdef DBG_swap
 		printf("(vm_do_claim_page) claiming page %p on frame %p\n",page->va,frame->kva);
 	#endif
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	frame_link(frame, page);
 
 	/* TODO: Insert page table entry to map page's VA to frame's PA. */
 	// page와 frame에 저장된 실제 physical memory 주소 (kernel vaddr) 관계를 page table에 등록
@@ -384,6 +804,7 @@ vm_do_claim_page (struct page *page) {
 		printf("(vm_do_claim_page) Fail at va %p, kva %p\n", page->va, page->frame->kva); // not reached?
 	#endif
 	//list_push_back(&frame_table, &frame->elem);
+	frame_unpin(frame);
 
 	return res;
 }
@@ -414,6 +835,11 @@ void hash_action_copy (struct hash_elem *e, void *hash_aux){
 		struct uninit_page *uninit = &page->uninit;
 		vm_initializer *init = uninit->init;
 		void *aux = uninit->aux;
+
+		if(aux == NULL){ // zero-fill page - nothing to load, nothing to copy
+			vm_alloc_page_with_initializer(uninit->type, page->va, page->writable, init, NULL);
+			return;
+		}
 	
 		// copy aux (struct lazy_load_info *)
 		struct lazy_load_info *lazy_load_info = malloc(sizeof(struct lazy_load_info));
@@ -436,15 +862,25 @@ void hash_action_copy (struct hash_elem *e, void *hash_aux){
 			newpage->page_cnt = page->page_cnt;
 		}
 	}
-	if(type & VM_ANON == VM_ANON){ // include stack pages
+	if(VM_TYPE(type) == VM_ANON){ // include stack pages
 		//when __do_fork is called, thread_current is the child thread so we can just use vm_alloc_page
 		vm_alloc_page(type, page->va, page->writable);
 
 		struct page *newpage = spt_find_page(&t->spt, page->va); // copied page
-		vm_do_claim_page(newpage);
-
-		ASSERT(page->frame != NULL);
-		memcpy(newpage->frame->kva, page->frame->kva, PGSIZE);
+		swap_in(newpage, NULL); // uninit -> anon, without claiming a frame
+
+		// Project 3 - Copy-on-write : share the parent's frame read-only instead of copying it;
+		// the first write from either side goes through vm_handle_wp
+		struct frame *frame = frame_pin(page);
+		if(frame != NULL){
+			frame_link(frame, newpage);
+			pml4_set_page(page->owner->pml4, page->va, frame->kva, false);
+			pml4_set_page(t->pml4, newpage->va, frame->kva, false);
+			frame_unpin(frame);
+			cow_share_cnt++;
+		}
+		else
+			anon_share_swap(newpage, page); // swapped out - share the swap slot
 	}
 	if(type == VM_FILE){
 		struct lazy_load_info *lazy_load_info = malloc(sizeof(struct lazy_load_info));
@@ -459,6 +895,7 @@ void hash_action_copy (struct hash_elem *e, void *hash_aux){
 
 		struct page *newpage = spt_find_page(&t->spt, page->va); // copied page
 		vm_do_claim_page(newpage);
+		fork_frame_cnt++;
 		
 		newpage->page_cnt = page->page_cnt;
 		newpage->writable = false;
@@ -477,6 +914,7 @@ void hash_action_destroy (struct hash_elem *e, void *aux){
 
 			ASSERT(page->frame != NULL);
 
+			vm_stat_count(VMSTAT_FILE_WRITEBACKS);
 			if(file_write_at(file, page->frame->kva, length, offset) != length){
 				// #ifdef DBG
 				// TODO - Not properly written-back
@@ -484,10 +922,6 @@ void hash_action_destroy (struct hash_elem *e, void *aux){
 		}
 	}
 	
-	if (page->frame != NULL){
-		page->frame->page = NULL;		
-	}
-	
 	// destroy(page);
 	// free(page->frame);
 	// free(page);
@@ -497,6 +931,7 @@ void hash_action_destroy (struct hash_elem *e, void *aux){
 void
 supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
 	hash_init (&spt->spt_hash, page_hash, page_less, NULL);
+	spt->swap_cursor = 0;
 }
 
 /* Copy supplemental page table from src to dst */
@@ -505,6 +940,7 @@ supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
 		struct supplemental_page_table *src UNUSED) {
 	src->spt_hash.aux = dst; // pass 'dst' as aux to 'hash_apply'
 	hash_apply(&src->spt_hash, hash_action_copy);
+	fork_cnt++;
 	return true;
 }
 
@@ -516,9 +952,20 @@ supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
 	hash_destroy(&spt->spt_hash, hash_action_destroy);
 }
 
+// Unmap the page and hand its frame back to the frame table, keeping the page itself
+static void hash_action_detach (struct hash_elem *e, void *aux UNUSED){
+	struct page *page = hash_entry(e, struct page, hash_elem);
+
+	// pml4_destroy must not free a frame that stays in the frame table,
+	// nor the zero page
+	pml4_clear_page(thread_current()->pml4, page->va);
+	if (page->frame != NULL)
+		page_detach_frame(page);
+}
+
 // Used in process_exec - process_cleanup : don't destroy SPT when it will be used afterwards!
 void
 supplemental_page_table_clear (struct supplemental_page_table *spt UNUSED) {
 	//hash_clear(&spt->spt_hash, hash_action_destroy); // exec-once
-	hash_clear(&spt->spt_hash, NULL);
+	hash_clear(&spt->spt_hash, hash_action_detach);
 }
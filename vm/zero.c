@@ -0,0 +1,118 @@
+/* zero.c: The shared zero page and the pool of pre-zeroed frames.
+ *
+ * An anonymous page with nothing to load, such as a stack page or a
+ * page of BSS, starts out all zeros. Until it is first written, every
+ * such page of every process can map one read-only frame of zeros;
+ * the write fault then gives it a frame of its own, which must be
+ * zeroed too. So that the fault does not pay for the memset, a
+ * kernel thread at the lowest priority, which runs only when nothing
+ * else wants the CPU, keeps a small pool of user frames it has
+ * already zeroed. */
+
+#include <stdio.h>
+#include <string.h>
+#include "vm/vm.h"
+#include "vm/zero.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Frames the zeroing thread keeps ready, and the level at which
+ * it is woken up to refill them. */
+#define ZERO_POOL_SIZE 16
+#define ZERO_POOL_LOW (ZERO_POOL_SIZE / 2)
+
+static void *zero_kva;                  /* The shared zero page. */
+
+static struct lock pool_lock;           /* Protects the pool below. */
+static void *pool[ZERO_POOL_SIZE];      /* Pre-zeroed user frames. */
+static size_t pool_cnt;                 /* Number of frames in POOL. */
+static struct condition pool_low;       /* Signaled when POOL drains. */
+
+/* Statistics. */
+static long long zeroed_cnt;            /* # of frames zeroed ahead of time. */
+static long long pool_hit_cnt;          /* # of frames taken from the pool. */
+static long long pool_miss_cnt;         /* # of times it was empty. */
+
+static thread_func zeroer_thread;
+
+/* Allocates the zero page and starts the zeroing thread. */
+void
+vm_zero_init (void) {
+	zero_kva = palloc_get_page (PAL_USER | PAL_ZERO | PAL_ASSERT);
+	lock_init (&pool_lock);
+	cond_init (&pool_low);
+	thread_create ("zeroer", PRI_MIN, zeroer_thread, NULL);
+}
+
+/* Returns the kernel address of the shared zero page. It must only
+ * ever be mapped read-only. */
+void *
+zero_page (void) {
+	return zero_kva;
+}
+
+/* Takes a user frame that is already filled with zeros out of the
+ * pool and returns it, or returns NULL if the pool is empty. */
+void *
+zero_pool_get (void) {
+	void *kva = NULL;
+
+	lock_acquire (&pool_lock);
+	if (pool_cnt > 0) {
+		kva = pool[--pool_cnt];
+		pool_hit_cnt++;
+	} else
+		pool_miss_cnt++;
+	if (pool_cnt <= ZERO_POOL_LOW)
+		cond_signal (&pool_low, &pool_lock);
+	lock_release (&pool_lock);
+	return kva;
+}
+
+/* Wakes the zeroing thread, which may have stopped because the user
+ * pool ran out, now that a user frame has been freed. */
+void
+zero_pool_kick (void) {
+	lock_acquire (&pool_lock);
+	if (pool_cnt < ZERO_POOL_SIZE)
+		cond_signal (&pool_low, &pool_lock);
+	lock_release (&pool_lock);
+}
+
+/* Prints zero page statistics. */
+void
+zero_print_stats (void) {
+	printf ("Zero: %lld frames zeroed ahead of time, "
+			"%lld taken from the pool, %lld found it empty\n",
+			zeroed_cnt, pool_hit_cnt, pool_miss_cnt);
+}
+
+/* Refills the pool whenever it drops to ZERO_POOL_LOW frames, one
+ * frame at a time, at the lowest priority. Stops when the user pool
+ * runs out, until the next frame is taken from the pool or freed. */
+static void
+zeroer_thread (void *aux UNUSED) {
+	if (thread_mlfqs)
+		thread_set_nice (20);
+
+	lock_acquire (&pool_lock);
+	for (;;) {
+		void *kva;
+
+		while (pool_cnt >= ZERO_POOL_SIZE)
+			cond_wait (&pool_low, &pool_lock);
+		lock_release (&pool_lock);
+
+		kva = palloc_get_page (PAL_USER);
+		if (kva != NULL)
+			memset (kva, 0, PGSIZE);
+
+		lock_acquire (&pool_lock);
+		if (kva == NULL)
+			cond_wait (&pool_low, &pool_lock);
+		else {
+			pool[pool_cnt++] = kva;
+			zeroed_cnt++;
+		}
+	}
+}